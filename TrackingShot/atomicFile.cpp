@@ -0,0 +1,37 @@
+#include <atomic>
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "atomicFile.h"
+
+std::string temporaryPath(const std::string& path)
+{
+    // the process id keeps instances apart, the counter the threads of this one
+    static std::atomic<unsigned int> counter(0);
+#ifdef _WIN32
+    unsigned long process = GetCurrentProcessId();
+#else
+    unsigned long process = (unsigned long)getpid();
+#endif
+    return path + "." + std::to_string(process) + "." + std::to_string(counter++) + ".tmp";
+}
+
+bool replaceFile(const std::string& temporary, const std::string& path)
+{
+#ifdef _WIN32
+    // rename fails on Windows if path exists
+    bool replaced = MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool replaced = std::rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+    if (!replaced)
+        std::remove(temporary.c_str());
+    return replaced;
+}
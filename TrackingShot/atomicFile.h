@@ -0,0 +1,11 @@
+#pragma once
+
+// cache files are written to a temporary file next to the target that replaces it in one step once it is complete,
+// so readers (other instances, views mapped with MappedFile) never see a partially written file
+
+#include <string>
+
+// unique name next to path for one writer (process and call)
+std::string temporaryPath(const std::string& path);
+// moves temporary over path, removes temporary and returns false if that fails (e.g. path is open on Windows)
+bool replaceFile(const std::string& temporary, const std::string& path);
@@ -0,0 +1,119 @@
+#pragma once
+
+// Benchmark mode
+// flies the camera along the same fixed route once for every registered configuration and reports the average
+// CPU and GPU frame times, so rendering techniques can be compared on the same frames.
+// started with the command line argument --benchmark
+
+#include <GL/glew.h> // include glew before gl.h (from glfw3)
+
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class Benchmark
+{
+public:
+    Benchmark(unsigned int framesPerRun = 600) : framesPerRun(framesPerRun), run(0), frame(0), timerQuery(0)
+    {
+    }
+
+    ~Benchmark()
+    {
+        if (timerQuery)
+            glDeleteQueries(1, &timerQuery);
+    }
+
+    // setup is called once before the first frame of the run and changes the global render settings
+    void addRun(const std::string& name, std::function<void()> setup)
+    {
+        runs.push_back({ name, setup, 0.0, 0.0, 0 });
+    }
+
+    bool isRunning() const
+    {
+        return run < runs.size();
+    }
+
+    // starts timing a frame, returns the position on the camera route in [0, 1)
+    float beginFrame()
+    {
+        if (!timerQuery)
+            glGenQueries(1, &timerQuery);
+        if (frame == 0)
+        {
+            std::cout << "benchmark: " << runs[run].name << std::endl;
+            runs[run].setup();
+        }
+        glBeginQuery(GL_TIME_ELAPSED, timerQuery);
+        frameStart = std::chrono::steady_clock::now();
+        return (float)frame / framesPerRun;
+    }
+
+    // number of objects drawn by the camera pass of the current frame
+    void countObjects(size_t objects)
+    {
+        runs[run].objects += objects;
+    }
+
+    // waits for the GPU to finish the frame and records its times
+    void endFrame()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        glFinish();
+        std::chrono::duration<double, std::milli> cpu = std::chrono::steady_clock::now() - frameStart;
+        GLuint64 gpu = 0;
+        glGetQueryObjectui64v(timerQuery, GL_QUERY_RESULT, &gpu);
+
+        // the first frames of a run warm up caches and the settings, they are not measured
+        if (frame >= WARMUP_FRAMES)
+        {
+            runs[run].cpuMs += cpu.count();
+            runs[run].gpuMs += gpu / 1.0e6;
+        }
+        else
+            runs[run].objects = 0;
+
+        if (++frame == framesPerRun)
+        {
+            frame = 0;
+            ++run;
+        }
+    }
+
+    void report() const
+    {
+        unsigned int measured = framesPerRun - WARMUP_FRAMES;
+        std::cout << std::fixed << std::setprecision(3);
+        std::cout << "benchmark results (average of " << measured << " frames):" << std::endl;
+        for (const Run& r : runs)
+        {
+            std::cout << "  " << std::left << std::setw(32) << r.name << std::right
+                << " frame " << r.cpuMs / measured << " ms, GPU " << r.gpuMs / measured << " ms, "
+                << (double)r.objects / measured << " objects drawn" << std::endl;
+        }
+        std::cout << std::defaultfloat;
+    }
+
+private:
+    static const unsigned int WARMUP_FRAMES = 30;
+
+    struct Run
+    {
+        std::string name;
+        std::function<void()> setup;
+        double cpuMs;
+        double gpuMs;
+        size_t objects;
+    };
+
+    std::vector<Run> runs;
+    unsigned int framesPerRun;
+    size_t run;
+    unsigned int frame;
+    GLuint timerQuery;
+    std::chrono::steady_clock::time_point frameStart;
+};
@@ -0,0 +1,515 @@
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <limits>
+
+#include "bvh.h"
+
+const unsigned int MAX_LEAF_ITEMS = 4;
+const int BINS = 16;
+// subtrees with more items than this are built on their own thread
+const unsigned int PARALLEL_BUILD_THRESHOLD = 1 << 14;
+// nodes with more items than this also split their bounds and binning passes across threads
+const unsigned int PARALLEL_BIN_THRESHOLD = 1 << 17;
+// SAH splits are used up to this depth, median splits below need at most 32 more levels for 2^32 items
+const unsigned int MAX_SAH_DEPTH = BVH_MAX_DEPTH - 32;
+// traversal stack, a depth first traversal holds at most one pending sibling per level
+const int STACK_SIZE = BVH_MAX_DEPTH + 1;
+
+static float surfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    glm::vec3 e = boundsMax - boundsMin;
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+static void grow(glm::vec3& boundsMin, glm::vec3& boundsMax, const glm::vec3& otherMin, const glm::vec3& otherMax)
+{
+    boundsMin = glm::min(boundsMin, otherMin);
+    boundsMax = glm::max(boundsMax, otherMax);
+}
+
+// slab test, returns the entry distance or infinity on a miss
+static float intersectRay(const glm::vec3& origin, const glm::vec3& invDirection, float maxDistance, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    glm::vec3 t0 = (boundsMin - origin) * invDirection;
+    glm::vec3 t1 = (boundsMax - origin) * invDirection;
+    glm::vec3 tSmall = glm::min(t0, t1);
+    glm::vec3 tBig = glm::max(t0, t1);
+    float tNear = glm::max(glm::max(tSmall.x, tSmall.y), glm::max(tSmall.z, 0.0f));
+    float tFar = glm::min(glm::min(tBig.x, tBig.y), glm::min(tBig.z, maxDistance));
+    return (tNear <= tFar) ? tNear : std::numeric_limits<float>::infinity();
+}
+
+// bounds of a range of build references
+struct RangeBounds
+{
+    glm::vec3 boundsMin, boundsMax;
+    glm::vec3 centroidMin, centroidMax;
+    unsigned int flags;
+
+    RangeBounds() : boundsMin(std::numeric_limits<float>::max()), boundsMax(-std::numeric_limits<float>::max()),
+        centroidMin(std::numeric_limits<float>::max()), centroidMax(-std::numeric_limits<float>::max()), flags(0)
+    {
+    }
+
+    void merge(const RangeBounds& other)
+    {
+        grow(boundsMin, boundsMax, other.boundsMin, other.boundsMax);
+        grow(centroidMin, centroidMax, other.centroidMin, other.centroidMax);
+        flags |= other.flags;
+    }
+};
+
+// item count and bounds per bin for all three axes
+struct BinSet
+{
+    unsigned int count[3][BINS];
+    glm::vec3 boundsMin[3][BINS], boundsMax[3][BINS];
+
+    BinSet()
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            for (int b = 0; b < BINS; ++b)
+            {
+                count[axis][b] = 0;
+                boundsMin[axis][b] = glm::vec3(std::numeric_limits<float>::max());
+                boundsMax[axis][b] = glm::vec3(-std::numeric_limits<float>::max());
+            }
+        }
+    }
+
+    void merge(const BinSet& other)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            for (int b = 0; b < BINS; ++b)
+            {
+                count[axis][b] += other.count[axis][b];
+                grow(boundsMin[axis][b], boundsMax[axis][b], other.boundsMin[axis][b], other.boundsMax[axis][b]);
+            }
+        }
+    }
+};
+
+// runs work(begin, end, result) over [first, first + count), split into one chunk per hardware thread for large ranges,
+// and merges the partial results
+template <typename Result, typename Work>
+static Result reduceRange(unsigned int first, unsigned int count, Work work)
+{
+    Result result;
+    unsigned int chunks = std::max(1u, std::thread::hardware_concurrency());
+    if (count <= PARALLEL_BIN_THRESHOLD || chunks == 1)
+    {
+        work(first, first + count, result);
+        return result;
+    }
+
+    unsigned int chunk = (count + chunks - 1) / chunks;
+    std::vector<std::future<Result>> tasks;
+    for (unsigned int begin = first; begin < first + count; begin += chunk)
+    {
+        unsigned int end = std::min(first + count, begin + chunk);
+        tasks.push_back(std::async(std::launch::async, [=]()
+        {
+            Result partial;
+            work(begin, end, partial);
+            return partial;
+        }));
+    }
+    for (std::future<Result>& task : tasks)
+        result.merge(task.get());
+    return result;
+}
+
+Bvh::Bvh() : nodesUsed(0)
+{
+}
+
+void Bvh::build(const std::vector<Aabb>& boxes, const std::vector<unsigned int>& flags)
+{
+    unsigned int count = (unsigned int)boxes.size();
+    itemBounds = boxes;
+    itemFlags = flags;
+    itemFlags.resize(count, 0);
+    itemLeaf.assign(count, BVH_NONE);
+
+    // the build partitions copies of the boxes instead of indices, so every pass reads memory sequentially
+    std::vector<BuildRef> refs(count);
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        refs[i].box = boxes[i];
+        refs[i].centroid = (boxes[i].boundsMin + boxes[i].boundsMax) * 0.5f;
+        refs[i].item = i;
+    }
+
+    // a binary tree with at most one item per leaf has 2n - 1 nodes, children are allocated in pairs from this pool
+    nodes.resize(std::max(1u, 2 * count));
+    nodesUsed = 1;
+    nodes[0].parent = BVH_NONE;
+    subdivide(0, refs.data(), 0, count, 0);
+
+    items.resize(count);
+    for (unsigned int i = 0; i < count; ++i)
+        items[i] = refs[i].item;
+}
+
+void Bvh::subdivide(unsigned int nodeIndex, BuildRef* refs, unsigned int first, unsigned int count, unsigned int depth)
+{
+    BvhNode& node = nodes[nodeIndex];
+    node.leftFirst = first;
+    node.count = count;
+
+    // node bounds and bounds of the centroids, the latter define the bins
+    RangeBounds range = reduceRange<RangeBounds>(first, count, [this, refs](unsigned int begin, unsigned int end, RangeBounds& result)
+    {
+        for (unsigned int i = begin; i < end; ++i)
+        {
+            grow(result.boundsMin, result.boundsMax, refs[i].box.boundsMin, refs[i].box.boundsMax);
+            grow(result.centroidMin, result.centroidMax, refs[i].centroid, refs[i].centroid);
+            result.flags |= itemFlags[refs[i].item];
+        }
+    });
+    node.boundsMin = range.boundsMin;
+    node.boundsMax = range.boundsMax;
+    node.flags = range.flags;
+
+    if (count <= MAX_LEAF_ITEMS)
+    {
+        makeLeaf(nodeIndex, refs, first, count);
+        return;
+    }
+
+    BuildRef* middle;
+    if (depth >= MAX_SAH_DEPTH)
+    {
+        // degenerate inputs (long chains of nested or lined up boxes) can make SAH split off a few items per level,
+        // past this depth the items are split in half at the median centroid of the widest axis instead
+        glm::vec3 extent = range.centroidMax - range.centroidMin;
+        int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z) ? 1 : 2;
+        middle = refs + first + count / 2;
+        std::nth_element(refs + first, middle, refs + first + count, [axis](const BuildRef& a, const BuildRef& b)
+        {
+            return a.centroid[axis] < b.centroid[axis];
+        });
+    }
+    else
+    {
+        // binned SAH: all three axes are binned in one pass, then the BINS - 1 planes between the bins are evaluated
+        glm::vec3 centroidMin = range.centroidMin;
+        glm::vec3 extent = range.centroidMax - range.centroidMin;
+        glm::vec3 scale;
+        for (int axis = 0; axis < 3; ++axis)
+            scale[axis] = (extent[axis] > 0) ? BINS / extent[axis] : 0.0f;
+
+        BinSet bins = reduceRange<BinSet>(first, count, [refs, centroidMin, scale](unsigned int begin, unsigned int end, BinSet& result)
+        {
+            for (unsigned int i = begin; i < end; ++i)
+            {
+                const BuildRef& ref = refs[i];
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    int b = std::min(BINS - 1, (int)((ref.centroid[axis] - centroidMin[axis]) * scale[axis]));
+                    ++result.count[axis][b];
+                    grow(result.boundsMin[axis][b], result.boundsMax[axis][b], ref.box.boundsMin, ref.box.boundsMax);
+                }
+            }
+        });
+
+        glm::vec3 inf(std::numeric_limits<float>::max());
+        int bestAxis = -1, bestSplit = 0;
+        float bestCost = count * surfaceArea(node.boundsMin, node.boundsMax); // cost of keeping this a leaf
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (extent[axis] <= 0)
+                continue;
+
+            // sweep from both sides to get area and count left / right of every plane
+            float leftArea[BINS - 1], rightArea[BINS - 1];
+            unsigned int leftCount[BINS - 1], rightCount[BINS - 1];
+            glm::vec3 leftMin = inf, leftMax = -inf, rightMin = inf, rightMax = -inf;
+            unsigned int leftSum = 0, rightSum = 0;
+            for (int b = 0; b < BINS - 1; ++b)
+            {
+                leftSum += bins.count[axis][b];
+                leftCount[b] = leftSum;
+                grow(leftMin, leftMax, bins.boundsMin[axis][b], bins.boundsMax[axis][b]);
+                leftArea[b] = leftSum ? surfaceArea(leftMin, leftMax) : 0;
+
+                rightSum += bins.count[axis][BINS - 1 - b];
+                rightCount[BINS - 2 - b] = rightSum;
+                grow(rightMin, rightMax, bins.boundsMin[axis][BINS - 1 - b], bins.boundsMax[axis][BINS - 1 - b]);
+                rightArea[BINS - 2 - b] = rightSum ? surfaceArea(rightMin, rightMax) : 0;
+            }
+            for (int b = 0; b < BINS - 1; ++b)
+            {
+                float cost = leftCount[b] * leftArea[b] + rightCount[b] * rightArea[b];
+                if (leftCount[b] && rightCount[b] && cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b;
+                }
+            }
+        }
+
+        // no split is cheaper (or all centroids coincide) -> keep as leaf
+        if (bestAxis < 0)
+        {
+            makeLeaf(nodeIndex, refs, first, count);
+            return;
+        }
+
+        middle = std::partition(refs + first, refs + first + count, [&](const BuildRef& ref)
+        {
+            int b = std::min(BINS - 1, (int)((ref.centroid[bestAxis] - centroidMin[bestAxis]) * scale[bestAxis]));
+            return b <= bestSplit;
+        });
+    }
+    unsigned int leftCount = (unsigned int)(middle - (refs + first));
+
+    unsigned int left = nodesUsed.fetch_add(2);
+    node.leftFirst = left;
+    node.count = 0;
+    nodes[left].parent = nodeIndex;
+    nodes[left + 1].parent = nodeIndex;
+
+    // the two halves work on disjoint ranges and node slots, large ones are built concurrently
+    if (count > PARALLEL_BUILD_THRESHOLD)
+    {
+        std::future<void> leftTask = std::async(std::launch::async, [=]()
+        {
+            subdivide(left, refs, first, leftCount, depth + 1);
+        });
+        subdivide(left + 1, refs, first + leftCount, count - leftCount, depth + 1);
+        leftTask.get();
+    }
+    else
+    {
+        subdivide(left, refs, first, leftCount, depth + 1);
+        subdivide(left + 1, refs, first + leftCount, count - leftCount, depth + 1);
+    }
+}
+
+void Bvh::makeLeaf(unsigned int nodeIndex, const BuildRef* refs, unsigned int first, unsigned int count)
+{
+    for (unsigned int i = first; i < first + count; ++i)
+        itemLeaf[refs[i].item] = nodeIndex;
+}
+
+void Bvh::updateBounds(unsigned int nodeIndex)
+{
+    BvhNode& node = nodes[nodeIndex];
+    if (node.count > 0)
+    {
+        node.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        node.boundsMax = -node.boundsMin;
+        for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+            grow(node.boundsMin, node.boundsMax, itemBounds[items[i]].boundsMin, itemBounds[items[i]].boundsMax);
+    }
+    else
+    {
+        const BvhNode& left = nodes[node.leftFirst];
+        const BvhNode& right = nodes[node.leftFirst + 1];
+        node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+        node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+    }
+}
+
+void Bvh::refit(unsigned int item, const Aabb& box)
+{
+    itemBounds[item] = box;
+    for (unsigned int n = itemLeaf[item]; n != BVH_NONE; n = nodes[n].parent)
+        updateBounds(n);
+}
+
+void Bvh::refit(const std::vector<Aabb>& boxes)
+{
+    itemBounds = boxes;
+    // children are always allocated after their parent, so a reverse sweep visits them first
+    for (unsigned int n = nodesUsed; n-- > 0;)
+        updateBounds(n);
+}
+
+void Bvh::collect(unsigned int nodeIndex, unsigned int requiredFlags, std::vector<unsigned int>& visible) const
+{
+    const BvhNode& node = nodes[nodeIndex];
+    if ((node.flags & requiredFlags) != requiredFlags)
+        return;
+    if (node.count > 0)
+    {
+        for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+            if ((itemFlags[items[i]] & requiredFlags) == requiredFlags)
+                visible.push_back(items[i]);
+        return;
+    }
+    collect(node.leftFirst, requiredFlags, visible);
+    collect(node.leftFirst + 1, requiredFlags, visible);
+}
+
+void Bvh::queryFrustum(const Frustum& frustum, unsigned int requiredFlags, std::vector<unsigned int>& visible) const
+{
+    if (itemBounds.empty())
+        return;
+
+    // the plane mask holds the planes the box still straddles, planes a parent is fully inside of are not tested again
+    struct Entry { unsigned int node; unsigned int planeMask; };
+    Entry stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = { 0, (1u << PLANE_COUNT) - 1 };
+
+    while (top > 0)
+    {
+        Entry entry = stack[--top];
+        const BvhNode& node = nodes[entry.node];
+        if ((node.flags & requiredFlags) != requiredFlags)
+            continue;
+
+        bool outside = false;
+        unsigned int mask = entry.planeMask;
+        for (int p = 0; p < PLANE_COUNT && !outside; ++p)
+        {
+            if (!(mask & (1u << p)))
+                continue;
+            const glm::vec4& plane = frustum.planes[p];
+            glm::vec3 normal(plane);
+            // farthest and nearest corner along the plane normal
+            glm::vec3 farCorner(plane.x >= 0 ? node.boundsMax.x : node.boundsMin.x,
+                          plane.y >= 0 ? node.boundsMax.y : node.boundsMin.y,
+                          plane.z >= 0 ? node.boundsMax.z : node.boundsMin.z);
+            glm::vec3 nearCorner(plane.x >= 0 ? node.boundsMin.x : node.boundsMax.x,
+                           plane.y >= 0 ? node.boundsMin.y : node.boundsMax.y,
+                           plane.z >= 0 ? node.boundsMin.z : node.boundsMax.z);
+            if (glm::dot(normal, farCorner) + plane.w < 0)
+                outside = true;
+            else if (glm::dot(normal, nearCorner) + plane.w >= 0)
+                mask &= ~(1u << p);
+        }
+        if (outside)
+            continue;
+
+        // completely inside: take the whole subtree without further tests
+        if (mask == 0)
+        {
+            collect(entry.node, requiredFlags, visible);
+            continue;
+        }
+
+        if (node.count > 0)
+        {
+            for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+            {
+                unsigned int item = items[i];
+                if ((itemFlags[item] & requiredFlags) == requiredFlags && frustum.intersects(itemBounds[item].boundsMin, itemBounds[item].boundsMax))
+                    visible.push_back(item);
+            }
+        }
+        else
+        {
+            stack[top++] = { node.leftFirst, mask };
+            stack[top++] = { node.leftFirst + 1, mask };
+        }
+    }
+}
+
+unsigned int Bvh::raycast(const glm::vec3& origin, const glm::vec3& direction, float& distance, unsigned int requiredFlags) const
+{
+    unsigned int hit = BVH_NONE;
+    distance = std::numeric_limits<float>::max();
+    if (itemBounds.empty())
+        return hit;
+
+    glm::vec3 invDirection = 1.0f / direction;
+    unsigned int stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const BvhNode& node = nodes[stack[--top]];
+        if ((node.flags & requiredFlags) != requiredFlags)
+            continue;
+        if (intersectRay(origin, invDirection, distance, node.boundsMin, node.boundsMax) >= distance)
+            continue;
+
+        if (node.count > 0)
+        {
+            for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+            {
+                unsigned int item = items[i];
+                if ((itemFlags[item] & requiredFlags) != requiredFlags)
+                    continue;
+                float t = intersectRay(origin, invDirection, distance, itemBounds[item].boundsMin, itemBounds[item].boundsMax);
+                if (t < distance)
+                {
+                    distance = t;
+                    hit = item;
+                }
+            }
+            continue;
+        }
+
+        // visit the nearer child first so the far one is more likely to be rejected by the shortened ray
+        const BvhNode& left = nodes[node.leftFirst];
+        const BvhNode& right = nodes[node.leftFirst + 1];
+        float tLeft = intersectRay(origin, invDirection, distance, left.boundsMin, left.boundsMax);
+        float tRight = intersectRay(origin, invDirection, distance, right.boundsMin, right.boundsMax);
+        if (tLeft < tRight)
+        {
+            stack[top++] = node.leftFirst + 1;
+            stack[top++] = node.leftFirst;
+        }
+        else
+        {
+            stack[top++] = node.leftFirst;
+            stack[top++] = node.leftFirst + 1;
+        }
+    }
+    return hit;
+}
+
+bool Bvh::occluded(const glm::vec3& from, const glm::vec3& to, unsigned int ignore, unsigned int requiredFlags) const
+{
+    if (itemBounds.empty())
+        return false;
+
+    glm::vec3 direction = to - from;
+    float length = glm::length(direction);
+    if (length <= 0)
+        return false;
+    direction /= length;
+    glm::vec3 invDirection = 1.0f / direction;
+
+    // any hit is enough, no ordering needed
+    unsigned int stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const BvhNode& node = nodes[stack[--top]];
+        if ((node.flags & requiredFlags) != requiredFlags)
+            continue;
+        if (intersectRay(from, invDirection, length, node.boundsMin, node.boundsMax) > length)
+            continue;
+
+        if (node.count > 0)
+        {
+            for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+            {
+                unsigned int item = items[i];
+                if (item == ignore || (itemFlags[item] & requiredFlags) != requiredFlags)
+                    continue;
+                // a box around the start point does not block the view out of it
+                const Aabb& box = itemBounds[item];
+                if (from.x >= box.boundsMin.x && from.y >= box.boundsMin.y && from.z >= box.boundsMin.z &&
+                    from.x <= box.boundsMax.x && from.y <= box.boundsMax.y && from.z <= box.boundsMax.z)
+                    continue;
+                if (intersectRay(from, invDirection, length, box.boundsMin, box.boundsMax) <= length)
+                    return true;
+            }
+            continue;
+        }
+        stack[top++] = node.leftFirst;
+        stack[top++] = node.leftFirst + 1;
+    }
+    return false;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+// Bounding volume hierarchy over the scene objects
+// built with a binned surface area heuristic (large subtrees are built in parallel) and refit in place
+// when objects move, so one structure serves frustum culling, shadow caster selection, picking and ray casts
+// https://jacco.ompf2.com/2022/04/13/how-to-build-a-bvh-part-1-basics/
+
+#include <glm.hpp>
+
+#include <atomic>
+#include <vector>
+
+#include "frustum.h"
+
+// marks a missing node or item (no parent, no hit)
+const unsigned int BVH_NONE = ~0u;
+// the build never makes the tree deeper than this, so traversals can use fixed size stacks
+const unsigned int BVH_MAX_DEPTH = 96;
+
+struct Aabb
+{
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+};
+
+struct BvhNode
+{
+    glm::vec3 boundsMin;
+    unsigned int leftFirst; // internal node: index of left child (right child follows), leaf: first entry in items
+    glm::vec3 boundsMax;
+    unsigned int count; // number of items in a leaf, 0 for internal nodes
+    unsigned int parent;
+    unsigned int flags; // union of the flags of all items below this node
+};
+
+class Bvh
+{
+public:
+    Bvh();
+
+    // (re)builds the hierarchy, flags are user defined bits per item that queries can filter on
+    void build(const std::vector<Aabb>& boxes, const std::vector<unsigned int>& flags);
+    // updates the bounds of one moved item and all nodes above it
+    void refit(unsigned int item, const Aabb& box);
+    // updates all bounds bottom up, for when many items moved
+    void refit(const std::vector<Aabb>& boxes);
+
+    // appends all items that intersect the frustum and have all requiredFlags set
+    void queryFrustum(const Frustum& frustum, unsigned int requiredFlags, std::vector<unsigned int>& visible) const;
+    // returns the closest item whose box is hit by the ray (or BVH_NONE) and the distance along direction
+    unsigned int raycast(const glm::vec3& origin, const glm::vec3& direction, float& distance, unsigned int requiredFlags = 0) const;
+    // true if any item with all requiredFlags set, except ignore and boxes containing from, blocks the segment from -> to
+    bool occluded(const glm::vec3& from, const glm::vec3& to, unsigned int ignore, unsigned int requiredFlags = 0) const;
+
+    size_t size() const { return itemBounds.size(); }
+    unsigned int nodeCount() const { return nodesUsed; }
+    const BvhNode& node(unsigned int index) const { return nodes[index]; }
+    const Aabb& bounds(unsigned int item) const { return itemBounds[item]; }
+    unsigned int itemAt(unsigned int index) const { return items[index]; }
+
+private:
+    // working copy of an item during the build
+    struct BuildRef
+    {
+        Aabb box;
+        glm::vec3 centroid;
+        unsigned int item;
+    };
+
+    void subdivide(unsigned int nodeIndex, BuildRef* refs, unsigned int first, unsigned int count, unsigned int depth);
+    void makeLeaf(unsigned int nodeIndex, const BuildRef* refs, unsigned int first, unsigned int count);
+    void updateBounds(unsigned int nodeIndex);
+    void collect(unsigned int nodeIndex, unsigned int requiredFlags, std::vector<unsigned int>& visible) const;
+
+    std::vector<BvhNode> nodes;
+    std::vector<unsigned int> items; // item indices, leaves reference ranges of this array
+    std::vector<unsigned int> itemLeaf; // leaf node of each item, for incremental refit
+    std::vector<Aabb> itemBounds;
+    std::vector<unsigned int> itemFlags;
+    std::atomic<unsigned int> nodesUsed;
+};
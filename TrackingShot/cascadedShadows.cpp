@@ -0,0 +1,172 @@
+#include <gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+
+#include "cascadedShadows.h"
+
+// shadows end at this distance from the camera, even if the camera sees farther
+const float SHADOW_DISTANCE = 40.0f;
+// blend between logarithmic (1) and uniform (0) split distances
+const float SPLIT_LAMBDA = 0.75f;
+// light space extents and depth ranges are rounded to this, so they do not change with every camera movement
+const float EXTENT_STEP = 1.0f;
+
+CascadedShadowMap::CascadedShadowMap(unsigned int size) : size(size)
+{
+    glGenTextures(1, &depthTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, depthTexture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, size, size, CASCADE_COUNT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    // depth compare in the texture unit, linear filtering turns every fetch into a bilinear 2x2 PCF
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    float borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    for (ShadowCascade& cascade : cascades)
+        cascade = { glm::mat4(1.0f), 0.0f, 1.0f };
+}
+
+CascadedShadowMap::~CascadedShadowMap()
+{
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &depthTexture);
+}
+
+// bounds of a world space box in the space of transform
+static Aabb transformBounds(const Aabb& box, const glm::mat4& transform)
+{
+    Aabb result = { glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()) };
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        glm::vec3 p((corner & 1) ? box.boundsMax.x : box.boundsMin.x, (corner & 2) ? box.boundsMax.y : box.boundsMin.y,
+            (corner & 4) ? box.boundsMax.z : box.boundsMin.z);
+        p = glm::vec3(transform * glm::vec4(p, 1.0f));
+        result.boundsMin = glm::min(result.boundsMin, p);
+        result.boundsMax = glm::max(result.boundsMax, p);
+    }
+    return result;
+}
+
+void CascadedShadowMap::fit(const glm::mat4& view, float fovy, float aspect, float zNear, float zFar, const glm::vec3& lightDirection,
+    const Aabb& receivers, const Aabb& casters, bool sceneDepth)
+{
+    // split distances, logarithmic near the camera where texels are large on screen
+    float shadowFar = std::min(zFar, SHADOW_DISTANCE);
+    float splits[CASCADE_COUNT + 1];
+    splits[0] = zNear;
+    for (unsigned int i = 1; i <= CASCADE_COUNT; ++i)
+    {
+        float p = (float)i / CASCADE_COUNT;
+        float logSplit = zNear * std::pow(shadowFar / zNear, p);
+        float uniformSplit = zNear + (shadowFar - zNear) * p;
+        splits[i] = SPLIT_LAMBDA * logSplit + (1.0f - SPLIT_LAMBDA) * uniformSplit;
+    }
+
+    // the light view only depends on the light direction, so snapping in its xy plane is stable
+    glm::vec3 direction = glm::normalize(lightDirection);
+    glm::vec3 up = (std::abs(direction.y) > 0.99f) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+    glm::mat4 inverseView = glm::inverse(view);
+
+    // scene bounds in light space: only receivers that also lie under a caster can be in shadow
+    Aabb receiverBounds = transformBounds(receivers, lightView);
+    Aabb casterBounds = transformBounds(casters, lightView);
+    glm::vec2 sceneMin = glm::max(glm::vec2(receiverBounds.boundsMin), glm::vec2(casterBounds.boundsMin));
+    glm::vec2 sceneMax = glm::min(glm::vec2(receiverBounds.boundsMax), glm::vec2(casterBounds.boundsMax));
+
+    // squared ratio of the half diagonal of a frustum cross section to its distance
+    float tanY = std::tan(glm::radians(fovy) * 0.5f);
+    float tanX = tanY * aspect;
+    float k = tanX * tanX + tanY * tanY;
+
+    for (unsigned int i = 0; i < CASCADE_COUNT; ++i)
+    {
+        // bounding sphere of the slice: the center lies on the view axis, equally far from the near and far corners
+        // radius and center distance do not depend on the camera orientation
+        float n = splits[i], f = splits[i + 1];
+        float centerDistance = std::min(0.5f * (f + n) * (1.0f + k), f);
+        float radius = std::sqrt((f - centerDistance) * (f - centerDistance) + k * f * f);
+        glm::vec3 center(lightView * inverseView * glm::vec4(0.0f, 0.0f, -centerDistance, 1.0f));
+
+        // receivers of the slice: its bounding square clipped to the scene
+        glm::vec2 rectMin = glm::max(glm::vec2(center) - radius, sceneMin);
+        glm::vec2 rectMax = glm::min(glm::vec2(center) + radius, sceneMax);
+        if (rectMin.x >= rectMax.x || rectMin.y >= rectMax.y)
+        {
+            rectMin = glm::vec2(center) - radius;
+            rectMax = glm::vec2(center) + radius;
+        }
+
+        // the extent only grows and shrinks in whole steps and the corner moves in whole texels,
+        // so the texels stay in place while the camera moves and the shadows do not shimmer
+        // one extra step covers the rounding of the corner
+        glm::vec2 extent = (glm::ceil((rectMax - rectMin) / EXTENT_STEP) + 1.0f) * EXTENT_STEP;
+        glm::vec2 texel = extent / (float)size;
+        rectMin = glm::floor(rectMin / texel) * texel;
+        rectMax = rectMin + extent;
+
+        // depth range of the receivers only, casters in front of it are clamped to the near plane by GL_DEPTH_CLAMP
+        // light space looks along -z, so depth is -z
+        float depthNear = -receiverBounds.boundsMax.z;
+        float depthFar = -receiverBounds.boundsMin.z;
+        if (!sceneDepth)
+        {
+            depthNear = std::max(depthNear, -center.z - radius);
+            depthFar = std::min(depthFar, -center.z + radius);
+        }
+        if (depthNear >= depthFar)
+        {
+            depthNear = -center.z - radius;
+            depthFar = -center.z + radius;
+        }
+        depthNear = std::floor(depthNear / EXTENT_STEP) * EXTENT_STEP;
+        depthFar = std::ceil(depthFar / EXTENT_STEP) * EXTENT_STEP;
+
+        glm::mat4 lightProjection = glm::ortho(rectMin.x, rectMax.x, rectMin.y, rectMax.y, depthNear, depthFar);
+        cascades[i].lightSpace = lightProjection * lightView;
+        cascades[i].splitFar = f;
+        cascades[i].depthRange = depthFar - depthNear;
+        cascades[i].lightView = lightView;
+        cascades[i].windowMin = rectMin;
+        cascades[i].texel = texel;
+        cascades[i].depthNear = depthNear;
+        cascades[i].depthFar = depthFar;
+    }
+}
+
+void CascadedShadowMap::bindCascade(unsigned int cascade) const
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, cascade);
+}
+
+void CascadedShadowMap::bindLayered() const
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0);
+}
+
+void CascadedShadowMap::setUniforms(const Shader& shader) const
+{
+    for (unsigned int i = 0; i < CASCADE_COUNT; ++i)
+    {
+        std::string index = "[" + std::to_string(i) + "]";
+        shader.setMat4("cascadeLightSpace" + index, cascades[i].lightSpace);
+        shader.setFloat("cascadeSplits" + index, cascades[i].splitFar);
+        shader.setFloat("cascadeDepthRange" + index, cascades[i].depthRange);
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+// Cascaded shadow maps
+// the camera frustum up to SHADOW_DISTANCE is cut into CASCADE_COUNT slices (practical split scheme), each covered
+// by its own orthographic light view in one layer of a GL_TEXTURE_2D_ARRAY. every light view is fitted to the bounding
+// sphere of its slice clipped to the scene bounds, quantized and snapped to whole texels, so the shadows do not
+// shimmer when the camera moves or turns.
+// https://developer.nvidia.com/gpugems/gpugems3/part-ii-light-and-shadows/chapter-10-parallel-split-shadow-maps-programmable-gpus
+
+#include <GL/glew.h> // include glew before gl.h (from glfw3)
+
+#include <glm.hpp>
+
+#include "bvh.h"
+#include "shader.h"
+
+// must match CASCADE_COUNT in lightingShader.fs
+const unsigned int CASCADE_COUNT = 3;
+
+struct ShadowCascade
+{
+    glm::mat4 lightSpace;
+    float splitFar; // view space distance from the camera the cascade reaches to
+    float depthRange; // world space depth covered by the light projection, to convert depth bias
+
+    // parts of lightSpace: the light view only follows the light direction, the window of the orthographic
+    // projection moves in whole texels over it, so depth rendered with the same view, texel and depth range lines up
+    glm::mat4 lightView;
+    glm::vec2 windowMin; // lower left corner of the projection in light view space
+    glm::vec2 texel; // light view size of one texel
+    float depthNear, depthFar;
+};
+
+class CascadedShadowMap
+{
+public:
+    CascadedShadowMap(unsigned int size);
+    ~CascadedShadowMap();
+
+    // fits the cascades to the camera frustum (vertical field of view in degrees) for a directional light,
+    // clipped to the world space bounds of all shadow receivers and casters
+    // the depth pass has to run with GL_DEPTH_CLAMP, the near planes are fitted to the receivers only
+    // sceneDepth gives every cascade the depth range of all receivers instead of the one of its slice, so the depth
+    // range does not follow the camera (for the ShadowCache, which can only reuse depth of the same range)
+    void fit(const glm::mat4& view, float fovy, float aspect, float zNear, float zFar, const glm::vec3& lightDirection,
+        const Aabb& receivers, const Aabb& casters, bool sceneDepth = false);
+    // binds the framebuffer with the layer of cascade attached, for rendering its depth
+    void bindCascade(unsigned int cascade) const;
+    // binds the framebuffer with all layers attached, for layered rendering (glClear clears all cascades)
+    void bindLayered() const;
+    // sets the cascade uniform arrays of the lighting shader
+    void setUniforms(const Shader& shader) const;
+
+    const ShadowCascade& cascade(unsigned int index) const { return cascades[index]; }
+    GLuint Texture() const { return depthTexture; }
+    GLuint Framebuffer() const { return fbo; }
+    unsigned int Size() const { return size; }
+
+private:
+    GLuint fbo;
+    GLuint depthTexture;
+    unsigned int size; // width and height of every cascade
+    ShadowCascade cascades[CASCADE_COUNT];
+};
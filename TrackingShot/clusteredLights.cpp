@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "clusteredLights.h"
+
+// texture buffer formats: light data, cluster ranges, light indices
+const GLenum BUFFER_FORMATS[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+
+LightClusters::LightClusters() : boundsFovy(0.0f), boundsAspect(0.0f), boundsNear(0.0f), boundsFar(0.0f),
+    tanHalfX(0.0f), tanHalfY(0.0f), lightCount(0)
+{
+    clusterRanges.resize(CLUSTER_COUNT * 2);
+    glGenBuffers(3, buffers);
+    glGenTextures(3, textures);
+    for (int i = 0; i < 3; ++i)
+    {
+        // texture buffers must not be empty when they are attached
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, BUFFER_FORMATS[i], buffers[i]);
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+LightClusters::~LightClusters()
+{
+    glDeleteTextures(3, textures);
+    glDeleteBuffers(3, buffers);
+}
+
+void LightClusters::updateBounds(float fovy, float aspect, float zNear, float zFar)
+{
+    if (fovy == boundsFovy && aspect == boundsAspect && zNear == boundsNear && zFar == boundsFar)
+        return;
+    boundsFovy = fovy;
+    boundsAspect = aspect;
+    boundsNear = zNear;
+    boundsFar = zFar;
+    tanHalfY = std::tan(glm::radians(fovy) * 0.5f);
+    tanHalfX = tanHalfY * aspect;
+
+    // box around the four corners of the tile at the near and far depth of the slice
+    clusterMin.resize(CLUSTER_COUNT);
+    clusterMax.resize(CLUSTER_COUNT);
+    for (unsigned int z = 0; z < CLUSTER_Z; ++z)
+    {
+        float sliceNear = zNear * std::pow(zFar / zNear, (float)z / CLUSTER_Z);
+        float sliceFar = zNear * std::pow(zFar / zNear, (float)(z + 1) / CLUSTER_Z);
+        for (unsigned int y = 0; y < CLUSTER_Y; ++y)
+        {
+            for (unsigned int x = 0; x < CLUSTER_X; ++x)
+            {
+                glm::vec3 boundsMin(std::numeric_limits<float>::max()), boundsMax(-std::numeric_limits<float>::max());
+                for (int corner = 0; corner < 4; ++corner)
+                {
+                    float ndcX = (float)(x + (corner & 1)) / CLUSTER_X * 2.0f - 1.0f;
+                    float ndcY = (float)(y + (corner >> 1)) / CLUSTER_Y * 2.0f - 1.0f;
+                    glm::vec3 direction(ndcX * tanHalfX, ndcY * tanHalfY, -1.0f);
+                    boundsMin = glm::min(boundsMin, glm::min(direction * sliceNear, direction * sliceFar));
+                    boundsMax = glm::max(boundsMax, glm::max(direction * sliceNear, direction * sliceFar));
+                }
+                unsigned int cluster = (z * CLUSTER_Y + y) * CLUSTER_X + x;
+                clusterMin[cluster] = boundsMin;
+                clusterMax[cluster] = boundsMax;
+            }
+        }
+    }
+}
+
+unsigned int LightClusters::slice(float depth) const
+{
+    float z = std::log(depth / boundsNear) / std::log(boundsFar / boundsNear) * CLUSTER_Z;
+    return (unsigned int)glm::clamp(z, 0.0f, (float)(CLUSTER_Z - 1));
+}
+
+void LightClusters::assign(const std::vector<Light*>& lights, const PointShadowAtlas& shadows, const glm::mat4& view,
+    float fovy, float aspect, float zNear, float zFar)
+{
+    updateBounds(fovy, aspect, zNear, zFar);
+
+    lightData.clear();
+    pairClusters.clear();
+    pairLights.clear();
+    std::fill(clusterRanges.begin(), clusterRanges.end(), 0);
+    lightCount = 0;
+    for (const Light* light : lights)
+    {
+        if (light->radius <= 0.0f)
+            continue;
+        unsigned int index = lightCount++;
+        lightData.push_back(glm::vec4(light->position, light->radius));
+        lightData.push_back(glm::vec4(light->color, (float)shadows.slotOf(light)));
+
+        // depth and screen range of the sphere's bounds, then the exact test against the clusters in that range
+        float radius = light->radius;
+        glm::vec3 center(view * glm::vec4(light->position, 1.0f));
+        float depth = -center.z;
+        if (depth + radius < zNear || depth - radius > zFar)
+            continue;
+        float depthMin = std::max(depth - radius, zNear);
+        float depthMax = std::min(depth + radius, zFar);
+
+        // smallest and largest x / depth and y / depth over the box, divided by the frustum extent
+        float ndcMinX = (center.x - radius) / (((center.x - radius < 0.0f) ? depthMin : depthMax) * tanHalfX);
+        float ndcMaxX = (center.x + radius) / (((center.x + radius > 0.0f) ? depthMin : depthMax) * tanHalfX);
+        float ndcMinY = (center.y - radius) / (((center.y - radius < 0.0f) ? depthMin : depthMax) * tanHalfY);
+        float ndcMaxY = (center.y + radius) / (((center.y + radius > 0.0f) ? depthMin : depthMax) * tanHalfY);
+        if (ndcMaxX < -1.0f || ndcMinX > 1.0f || ndcMaxY < -1.0f || ndcMinY > 1.0f)
+            continue;
+        unsigned int x0 = (unsigned int)glm::clamp((ndcMinX * 0.5f + 0.5f) * CLUSTER_X, 0.0f, (float)(CLUSTER_X - 1));
+        unsigned int x1 = (unsigned int)glm::clamp((ndcMaxX * 0.5f + 0.5f) * CLUSTER_X, 0.0f, (float)(CLUSTER_X - 1));
+        unsigned int y0 = (unsigned int)glm::clamp((ndcMinY * 0.5f + 0.5f) * CLUSTER_Y, 0.0f, (float)(CLUSTER_Y - 1));
+        unsigned int y1 = (unsigned int)glm::clamp((ndcMaxY * 0.5f + 0.5f) * CLUSTER_Y, 0.0f, (float)(CLUSTER_Y - 1));
+        unsigned int z0 = slice(depthMin), z1 = slice(depthMax);
+
+        float radiusSquared = radius * radius;
+        for (unsigned int z = z0; z <= z1; ++z)
+        {
+            for (unsigned int y = y0; y <= y1; ++y)
+            {
+                for (unsigned int x = x0; x <= x1; ++x)
+                {
+                    unsigned int cluster = (z * CLUSTER_Y + y) * CLUSTER_X + x;
+                    glm::vec3 closest = glm::clamp(center, clusterMin[cluster], clusterMax[cluster]);
+                    glm::vec3 offset = closest - center;
+                    if (glm::dot(offset, offset) > radiusSquared)
+                        continue;
+                    pairClusters.push_back(cluster);
+                    pairLights.push_back(index);
+                    ++clusterRanges[cluster * 2 + 1];
+                }
+            }
+        }
+    }
+
+    // counting sort of the pairs by cluster: offsets from the counts, then every light goes to the end of its cluster
+    unsigned int offset = 0;
+    for (unsigned int cluster = 0; cluster < CLUSTER_COUNT; ++cluster)
+    {
+        clusterRanges[cluster * 2] = offset;
+        offset += clusterRanges[cluster * 2 + 1];
+        clusterRanges[cluster * 2 + 1] = 0;
+    }
+    lightIndices.resize(offset);
+    for (size_t i = 0; i < pairClusters.size(); ++i)
+    {
+        unsigned int cluster = pairClusters[i];
+        lightIndices[clusterRanges[cluster * 2] + clusterRanges[cluster * 2 + 1]++] = pairLights[i];
+    }
+
+    // orphan and refill, texture buffers must not be empty
+    const void* data[3] = { lightData.data(), clusterRanges.data(), lightIndices.data() };
+    size_t sizes[3] = { lightData.size() * sizeof(glm::vec4), clusterRanges.size() * sizeof(unsigned int), lightIndices.size() * sizeof(unsigned int) };
+    for (int i = 0; i < 3; ++i)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, std::max(sizes[i], sizeof(glm::vec4)), NULL, GL_STREAM_DRAW);
+        if (sizes[i] > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, sizes[i], data[i]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::bind(GLuint unit) const
+{
+    for (GLuint i = 0; i < 3; ++i)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit + i);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void LightClusters::setUniforms(const Shader& shader, unsigned int width, unsigned int height) const
+{
+    shader.setInt("lightCount", (int)lightCount);
+    shader.setVec2("clusterScale", (float)CLUSTER_X / width, (float)CLUSTER_Y / height);
+    // slice = log(depth / near) / log(far / near) * CLUSTER_Z = log(depth) * scale + bias
+    float scale = CLUSTER_Z / std::log(boundsFar / boundsNear);
+    shader.setVec2("clusterDepth", scale, -std::log(boundsNear) * scale);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+// Clustered forward lighting
+// the view frustum is split into CLUSTER_X x CLUSTER_Y screen tiles and CLUSTER_Z exponentially growing depth slices.
+// every frame the point lights are assigned on the CPU to the clusters their sphere touches, and the lighting shader
+// only loops over the lights of the fragment's cluster, so the cost per pixel depends on the local light count.
+// lights, the cluster ranges and the light indices are read through texture buffers, which the GL 3.3 path has.
+// http://www.cse.chalmers.se/~uffe/clustered_shading_preprint.pdf (Olsson, Billeter, Assarsson)
+
+#include <GL/glew.h> // include glew before gl.h (from glfw3)
+
+#include <glm.hpp>
+
+#include <vector>
+
+#include "light.h"
+#include "pointShadows.h"
+#include "shader.h"
+
+// must match lightingShader.fs
+const unsigned int CLUSTER_X = 16;
+const unsigned int CLUSTER_Y = 12;
+const unsigned int CLUSTER_Z = 24;
+const unsigned int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+
+class LightClusters
+{
+public:
+    LightClusters();
+    ~LightClusters();
+
+    // assigns the point lights (radius > 0) of lights to the clusters of the camera (vertical field of view in degrees)
+    // and uploads lights, cluster ranges and light indices; shadows provides the atlas slot of shadowed lights
+    void assign(const std::vector<Light*>& lights, const PointShadowAtlas& shadows, const glm::mat4& view,
+        float fovy, float aspect, float zNear, float zFar);
+    // binds the texture buffers to unit, unit + 1 and unit + 2
+    void bind(GLuint unit) const;
+    // lightCount, clusterScale and clusterDepth for a viewport of width x height
+    void setUniforms(const Shader& shader, unsigned int width, unsigned int height) const;
+
+    unsigned int LightCount() const { return lightCount; }
+    // light indices stored for all clusters, i.e. the total work of the lighting shader in light tests
+    size_t IndexCount() const { return lightIndices.size(); }
+
+private:
+    // view space bounds of the clusters, only recomputed when the projection changes
+    void updateBounds(float fovy, float aspect, float zNear, float zFar);
+    unsigned int slice(float depth) const;
+
+    float boundsFovy, boundsAspect, boundsNear, boundsFar;
+    std::vector<glm::vec3> clusterMin, clusterMax;
+    float tanHalfX, tanHalfY;
+
+    unsigned int lightCount;
+    std::vector<glm::vec4> lightData; // per light: position and radius, color and shadow slot
+    std::vector<unsigned int> pairClusters, pairLights; // every (cluster, light) intersection, in light order
+    std::vector<unsigned int> clusterRanges; // per cluster: offset into lightIndices and light count
+    std::vector<unsigned int> lightIndices;
+
+    GLuint buffers[3]; // light data, cluster ranges, light indices
+    GLuint textures[3];
+};
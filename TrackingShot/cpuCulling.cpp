@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <thread>
+
+#include "cpuCulling.h"
+
+// MSVC defines __AVX2__ with /arch:AVX2 (EnableEnhancedInstructionSet in the project), gcc and clang with -mavx2
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CULL_AVX2
+#endif
+
+// boxes per thread, more than this are split up (one core handles this well below a millisecond)
+const size_t PARALLEL_THRESHOLD = 1 << 20;
+// lanes of one AVX2 register
+const size_t LANES = 8;
+
+void CullingBounds::clear()
+{
+    minX.clear(); minY.clear(); minZ.clear();
+    maxX.clear(); maxY.clear(); maxZ.clear();
+}
+
+void CullingBounds::add(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    minX.push_back(boundsMin.x); minY.push_back(boundsMin.y); minZ.push_back(boundsMin.z);
+    maxX.push_back(boundsMax.x); maxY.push_back(boundsMax.y); maxZ.push_back(boundsMax.z);
+}
+
+#ifdef CULL_AVX2
+// for every 8 bit visibility mask: the lane indices of the set bits packed to the front and their count
+struct LeftPackTable
+{
+    alignas(32) unsigned int lanes[256][LANES];
+    unsigned int count[256];
+
+    LeftPackTable()
+    {
+        for (unsigned int mask = 0; mask < 256; ++mask)
+        {
+            count[mask] = 0;
+            for (unsigned int lane = 0; lane < LANES; ++lane)
+            {
+                lanes[mask][lane] = 0;
+                if (mask & (1 << lane))
+                    lanes[mask][count[mask]++] = lane;
+            }
+        }
+    }
+};
+static const LeftPackTable leftPack;
+#endif
+
+// tests the boxes [begin, end) and writes the visible indices to out, which needs room for end - begin + LANES entries
+// returns the number of visible boxes
+static size_t cullRange(const Frustum& frustum, const CullingBounds& bounds, size_t begin, size_t end, unsigned int* out)
+{
+    // the sign of a plane normal is the same for all boxes, so the corner farthest along it is selected once per plane
+    const float* px[PLANE_COUNT];
+    const float* py[PLANE_COUNT];
+    const float* pz[PLANE_COUNT];
+    for (int p = 0; p < PLANE_COUNT; ++p)
+    {
+        px[p] = (frustum.planes[p].x >= 0) ? bounds.maxX.data() : bounds.minX.data();
+        py[p] = (frustum.planes[p].y >= 0) ? bounds.maxY.data() : bounds.minY.data();
+        pz[p] = (frustum.planes[p].z >= 0) ? bounds.maxZ.data() : bounds.minZ.data();
+    }
+
+    size_t count = 0;
+    size_t i = begin;
+#ifdef CULL_AVX2
+    __m256 nx[PLANE_COUNT], ny[PLANE_COUNT], nz[PLANE_COUNT], nw[PLANE_COUNT];
+    for (int p = 0; p < PLANE_COUNT; ++p)
+    {
+        nx[p] = _mm256_set1_ps(frustum.planes[p].x);
+        ny[p] = _mm256_set1_ps(frustum.planes[p].y);
+        nz[p] = _mm256_set1_ps(frustum.planes[p].z);
+        nw[p] = _mm256_set1_ps(frustum.planes[p].w);
+    }
+    const __m256 zero = _mm256_setzero_ps();
+
+    for (; i + LANES <= end; i += LANES)
+    {
+        __m256 outside = zero;
+        for (int p = 0; p < PLANE_COUNT; ++p)
+        {
+            __m256 d = _mm256_add_ps(_mm256_mul_ps(nx[p], _mm256_loadu_ps(px[p] + i)), nw[p]);
+            d = _mm256_add_ps(d, _mm256_mul_ps(ny[p], _mm256_loadu_ps(py[p] + i)));
+            d = _mm256_add_ps(d, _mm256_mul_ps(nz[p], _mm256_loadu_ps(pz[p] + i)));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, zero, _CMP_LT_OQ));
+        }
+        int mask = ~_mm256_movemask_ps(outside) & 0xFF;
+
+        // store all 8 packed indices, only the first count[mask] of them are kept
+        __m256i lanes = _mm256_load_si256((const __m256i*)leftPack.lanes[mask]);
+        __m256i indices = _mm256_add_epi32(lanes, _mm256_set1_epi32((int)i));
+        _mm256_storeu_si256((__m256i*)(out + count), indices);
+        count += leftPack.count[mask];
+    }
+#endif
+
+    // scalar remainder (or everything without AVX2)
+    for (; i < end; ++i)
+    {
+        bool inside = true;
+        for (int p = 0; p < PLANE_COUNT && inside; ++p)
+        {
+            const glm::vec4& plane = frustum.planes[p];
+            inside = plane.x * px[p][i] + plane.y * py[p][i] + plane.z * pz[p][i] + plane.w >= 0;
+        }
+        if (inside)
+            out[count++] = (unsigned int)i;
+    }
+    return count;
+}
+
+void cullFrustum(const Frustum& frustum, const CullingBounds& bounds, std::vector<unsigned int>& visible)
+{
+    size_t total = bounds.size();
+    size_t first = visible.size();
+
+    // rounded up, so the work is split as soon as it exceeds the threshold
+    size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), (total + PARALLEL_THRESHOLD - 1) / PARALLEL_THRESHOLD);
+    if (threads <= 1)
+    {
+        visible.resize(first + total + LANES);
+        size_t count = cullRange(frustum, bounds, 0, total, visible.data() + first);
+        visible.resize(first + count);
+        return;
+    }
+
+    // every thread culls one contiguous chunk into its own list, the lists are concatenated in order afterwards
+    size_t chunk = (total + threads - 1) / threads;
+    std::vector<std::vector<unsigned int>> results(threads);
+    std::vector<size_t> counts(threads, 0);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t)
+    {
+        size_t begin = t * chunk;
+        size_t end = std::min(total, begin + chunk);
+        workers.emplace_back([&, t, begin, end]()
+        {
+            results[t].resize(end - begin + LANES);
+            counts[t] = cullRange(frustum, bounds, begin, end, results[t].data());
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+
+    for (size_t t = 0; t < threads; ++t)
+        visible.insert(visible.end(), results[t].begin(), results[t].begin() + counts[t]);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+// CPU frustum culling for the GL 3.3 path
+// bounding boxes are kept as structure of arrays so 8 boxes are tested at once with AVX2,
+// visible indices are written compactly and very large sets are split across threads
+
+#include <glm.hpp>
+
+#include <vector>
+
+#include "frustum.h"
+
+// world space bounding boxes in structure of arrays layout, index i belongs to renderable i
+struct CullingBounds
+{
+    std::vector<float> minX, minY, minZ;
+    std::vector<float> maxX, maxY, maxZ;
+
+    void clear();
+    void add(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+    size_t size() const { return minX.size(); }
+};
+
+// appends the indices of all boxes intersecting the frustum to visible, in ascending order
+void cullFrustum(const Frustum& frustum, const CullingBounds& bounds, std::vector<unsigned int>& visible);
@@ -0,0 +1,66 @@
+#pragma once
+// Frustum helper functions
+// extracts the six clipping planes of a view-projection matrix and tests bounding boxes against them
+// http://www.cs.otago.ac.nz/postgrads/alexis/planeExtraction.pdf (Gribb / Hartmann)
+
+// GLM Mathematics
+#include <glm.hpp>
+
+enum Frustum_Plane {
+    PLANE_LEFT,
+    PLANE_RIGHT,
+    PLANE_BOTTOM,
+    PLANE_TOP,
+    PLANE_NEAR,
+    PLANE_FAR,
+    PLANE_COUNT
+};
+
+struct Frustum
+{
+    // xyz: normal pointing into the frustum, w: distance -> inside if dot(n, p) + w >= 0
+    glm::vec4 planes[PLANE_COUNT];
+
+    // extract the planes from a combined projection * view matrix (glm is column major -> rows are m[0][i]..m[3][i])
+    static Frustum fromMatrix(const glm::mat4& m)
+    {
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        Frustum frustum;
+        frustum.planes[PLANE_LEFT] = row3 + row0;
+        frustum.planes[PLANE_RIGHT] = row3 - row0;
+        frustum.planes[PLANE_BOTTOM] = row3 + row1;
+        frustum.planes[PLANE_TOP] = row3 - row1;
+        frustum.planes[PLANE_NEAR] = row3 + row2;
+        frustum.planes[PLANE_FAR] = row3 - row2;
+
+        // normalize so the distances are in world units
+        for (int i = 0; i < PLANE_COUNT; ++i)
+            frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+
+        return frustum;
+    }
+
+    // turns the near plane into one that everything passes, e.g. for light views drawn with depth clamping
+    void ignoreNearPlane()
+    {
+        planes[PLANE_NEAR] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    // true if the axis aligned box is (at least partially) inside; only tests the corner farthest along each plane normal
+    bool intersects(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+    {
+        for (int i = 0; i < PLANE_COUNT; ++i)
+        {
+            glm::vec3 p(planes[i].x >= 0 ? boundsMax.x : boundsMin.x,
+                        planes[i].y >= 0 ? boundsMax.y : boundsMin.y,
+                        planes[i].z >= 0 ? boundsMax.z : boundsMin.z);
+            if (glm::dot(glm::vec3(planes[i]), p) + planes[i].w < 0)
+                return false;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,61 @@
+#include <iostream>
+
+#include "gBuffer.h"
+
+static GLuint createTarget(unsigned int width, unsigned int height, GLint internalFormat, GLenum format, GLenum type)
+{
+    // the lighting pass reads one texel per pixel with texelFetch
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+GBuffer::GBuffer(unsigned int width, unsigned int height) : width(width), height(height)
+{
+    // RG16F instead of RG16_SNORM for the normal, snorm formats are not color renderable in GL 3.3
+    textures[GBUFFER_ALBEDO] = createTarget(width, height, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+    textures[GBUFFER_NORMAL] = createTarget(width, height, GL_RG16F, GL_RG, GL_HALF_FLOAT);
+    textures[GBUFFER_DEPTH] = createTarget(width, height, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[GBUFFER_ALBEDO], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, textures[GBUFFER_NORMAL], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textures[GBUFFER_DEPTH], 0);
+    const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "G-buffer framebuffer is not complete" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+GBuffer::~GBuffer()
+{
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(GBUFFER_TEXTURE_COUNT, textures);
+}
+
+void GBuffer::begin() const
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+    // albedo and normal are only read where depth < 1, no need to clear them
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void GBuffer::bind(GLuint unit) const
+{
+    for (GLuint i = 0; i < GBUFFER_TEXTURE_COUNT; ++i)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit + i);
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+// G-buffer of the deferred shading path
+// the geometry pass writes the normal mapped surface into three compact targets: RGBA8 albedo (alpha 0 marks unlit
+// materials, which the lighting pass passes through), the world space normal octahedral encoded into two RG16F
+// channels and the depth texture, from which the lighting pass reconstructs the position. 12 bytes per pixel, the lighting pass then shades every pixel once whatever the overdraw of the scene.
+// http://jcgt.org/published/0003/02/01/ (Cigolle et al., survey of efficient representations for unit vectors)
+
+#include <GL/glew.h> // include glew before gl.h (from glfw3)
+
+// must match the samplers of the deferred path in lightingShader.fs
+enum GBuffer_Texture {
+    GBUFFER_ALBEDO,
+    GBUFFER_NORMAL,
+    GBUFFER_DEPTH,
+    GBUFFER_TEXTURE_COUNT
+};
+
+class GBuffer
+{
+public:
+    GBuffer(unsigned int width, unsigned int height);
+    ~GBuffer();
+
+    // binds the framebuffer for the geometry pass and clears it
+    void begin() const;
+    // binds albedo, normal and depth to unit, unit + 1 and unit + 2
+    void bind(GLuint unit) const;
+
+private:
+    GLuint fbo;
+    GLuint textures[GBUFFER_TEXTURE_COUNT];
+    unsigned int width, height;
+};
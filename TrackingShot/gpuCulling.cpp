@@ -0,0 +1,149 @@
+#include <cstddef> // offsetof
+
+#include "gpuCulling.h"
+#include "frustum.h"
+
+// std430 layout of one object, must match the Object struct in object.glsl
+struct GpuObject
+{
+    glm::mat4 model;
+    glm::vec4 color;
+    glm::vec4 boundsMin; // w: Renderable_Flags
+    glm::vec4 boundsMax; // w: material
+    glm::vec4 normalMatrix[3]; // columns of the mat3, std430 pads them to vec4
+};
+
+// layout defined by the GL spec for glDrawArraysIndirect
+struct DrawArraysIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;
+};
+
+const GLuint WORKGROUP_SIZE = 64; // local_size_x in cullShader.cs
+const GLuint CUBE_VERTICES = 36;
+
+unsigned int GpuCuller::rangeCount(Cull_Pass pass)
+{
+    return (pass == CULL_SHADOW) ? (unsigned int)SHADOW_RANGE_COUNT : (unsigned int)MATERIAL_COUNT;
+}
+
+bool GpuCuller::isSupported()
+{
+    return GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object && GLEW_ARB_draw_indirect;
+}
+
+GpuCuller::GpuCuller() : cullShader("shaders/cullShader.cs"), capacity(0), objectCount(0)
+{
+    glGenBuffers(1, &objectBuffer);
+    glGenBuffers(CULL_PASS_COUNT, instanceBuffer);
+    glGenBuffers(CULL_PASS_COUNT, commandBuffer);
+
+    for (int pass = 0; pass < CULL_PASS_COUNT; ++pass)
+    {
+        std::vector<DrawArraysIndirectCommand> commands(rangeCount((Cull_Pass)pass), DrawArraysIndirectCommand{ CUBE_VERTICES, 0, 0, 0 });
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer[pass]);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawArraysIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+GpuCuller::~GpuCuller()
+{
+    glDeleteBuffers(1, &objectBuffer);
+    glDeleteBuffers(CULL_PASS_COUNT, instanceBuffer);
+    glDeleteBuffers(CULL_PASS_COUNT, commandBuffer);
+    glDeleteProgram(cullShader.ID);
+}
+
+void GpuCuller::upload(const std::vector<Renderable>& renderables)
+{
+    std::vector<GpuObject> objects(renderables.size());
+    for (size_t i = 0; i < renderables.size(); ++i)
+    {
+        const Renderable& r = renderables[i];
+        objects[i].model = r.model;
+        objects[i].color = r.color;
+        objects[i].boundsMin = glm::vec4(r.boundsMin, (float)renderableFlags(r));
+        objects[i].boundsMax = glm::vec4(r.boundsMax, (float)r.material);
+        for (int column = 0; column < 3; ++column)
+            objects[i].normalMatrix[column] = glm::vec4(r.normalMatrix[column], 0.0f);
+    }
+    objectCount = (unsigned int)objects.size();
+
+    // grow all buffers together, every range of the instance buffers needs room for every object being visible
+    if (objects.size() > capacity)
+    {
+        capacity = objects.size() * 2;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(GpuObject), nullptr, GL_DYNAMIC_DRAW);
+        for (int pass = 0; pass < CULL_PASS_COUNT; ++pass)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer[pass]);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * rangeCount((Cull_Pass)pass) * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+        }
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, objects.size() * sizeof(GpuObject), objects.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuCuller::cull(Cull_Pass pass, const glm::mat4& viewProjection)
+{
+    // reset the instance counts, the compute shader increments the one of its range for every visible object
+    GLuint zero = 0;
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer[pass]);
+    for (unsigned int range = 0; range < rangeCount(pass); ++range)
+    {
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, range * sizeof(DrawArraysIndirectCommand) + offsetof(DrawArraysIndirectCommand, instanceCount),
+            sizeof(GLuint), &zero);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    Frustum frustum = Frustum::fromMatrix(viewProjection);
+    if (pass == CULL_SHADOW)
+        frustum.ignoreNearPlane();
+    cullShader.use();
+    for (int i = 0; i < PLANE_COUNT; ++i)
+        cullShader.setVec4("planes[" + std::to_string(i) + "]", frustum.planes[i]);
+    cullShader.setInt("objectCount", (int)objectCount);
+    cullShader.setInt("instanceCapacity", (int)capacity);
+    cullShader.setBool("shadowPass", pass == CULL_SHADOW);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, objectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, instanceBuffer[pass]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBuffer[pass]);
+    glDispatchCompute((objectCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+}
+
+void GpuCuller::draw(Cull_Pass pass, Material material, const Shader& shader)
+{
+    drawRange(pass, material, shader);
+}
+
+void GpuCuller::draw(Shadow_Range range, const Shader& shader)
+{
+    drawRange(CULL_SHADOW, range, shader);
+}
+
+void GpuCuller::draw(Cull_Pass pass, const Shader& shader)
+{
+    for (unsigned int range = 0; range < rangeCount(pass); ++range)
+        drawRange(pass, range, shader);
+}
+
+void GpuCuller::drawRange(Cull_Pass pass, unsigned int range, const Shader& shader)
+{
+    // make the compute results visible to the vertex shader and the indirect command fetch
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+    // gl_InstanceID starts at 0 for every command (gl_BaseInstance needs GL 4.6), so the range is passed as a uniform
+    shader.setInt("firstInstance", (int)(range * capacity));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, objectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, instanceBuffer[pass]);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer[pass]);
+    glDrawArraysIndirect(GL_TRIANGLES, (const void*)(range * sizeof(DrawArraysIndirectCommand)));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+// GPU frustum culling feeding indirect draws
+// a compute shader tests every object's bounding box against a frustum and compacts the visible
+// object indices into an instance buffer plus a DrawArraysIndirectCommand, so no CPU readback is needed.
+// every material has its own command and range of the instance buffer, so each is drawn with its own program.
+// the shadow pass splits its casters into a static and a dynamic range instead, for the cached shadow map.
+// needs OpenGL 4.3 (compute shaders, shader storage buffers, indirect draws)
+
+#include <GL/glew.h> // include glew before gl.h (from glfw3)
+
+#include <glm.hpp>
+
+#include <vector>
+
+#include "renderable.h"
+#include "shader.h"
+
+// every pass owns its own command and instance buffer, so all passes can be culled before drawing
+enum Cull_Pass {
+    CULL_CAMERA,
+    CULL_SHADOW,
+    CULL_PASS_COUNT
+};
+
+// ranges of the shadow pass
+enum Shadow_Range {
+    SHADOW_STATIC,
+    SHADOW_DYNAMIC,
+    SHADOW_RANGE_COUNT
+};
+
+class GpuCuller
+{
+public:
+    // true if the current context provides everything needed for the compute path
+    static bool isSupported();
+
+    GpuCuller();
+    ~GpuCuller();
+
+    // copies the renderables of this frame into the object buffer
+    void upload(const std::vector<Renderable>& renderables);
+    // runs the culling compute shader for the given pass and view-projection matrix
+    void cull(Cull_Pass pass, const glm::mat4& viewProjection);
+    // binds object and instance buffers and issues the indirect draw of the cube mesh (36 vertices) for the visible
+    // objects of material; shader is the program in use, one of the *Indirect.vs variants
+    void draw(Cull_Pass pass, Material material, const Shader& shader);
+    // the same for the static or dynamic casters of the shadow pass
+    void draw(Shadow_Range range, const Shader& shader);
+    // the same for all visible objects of the pass, for passes that draw every material alike (depth)
+    void draw(Cull_Pass pass, const Shader& shader);
+
+private:
+    // number of ranges of the instance buffer and commands of pass
+    static unsigned int rangeCount(Cull_Pass pass);
+    void drawRange(Cull_Pass pass, unsigned int range, const Shader& shader);
+
+    Shader cullShader;
+    GLuint objectBuffer;
+    GLuint instanceBuffer[CULL_PASS_COUNT]; // a range of capacity instances per material or shadow range
+    GLuint commandBuffer[CULL_PASS_COUNT]; // a command per range
+    size_t capacity; // number of objects the buffers can hold
+    unsigned int objectCount;
+};
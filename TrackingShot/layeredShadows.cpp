@@ -0,0 +1,71 @@
+#include <cstddef>
+
+#include "layeredShadows.h"
+
+bool LayeredDepthRenderer::vertexLayerSupported()
+{
+    return GLEW_ARB_shader_viewport_layer_array || GLEW_AMD_vertex_shader_layer;
+}
+
+LayeredDepthRenderer::LayeredDepthRenderer(GLuint meshBuffer, GLsizei meshStride, Shader* program) : shader(program),
+    instanceBuffer(0), capacity(0)
+{
+    if (!shader)
+    {
+        if (vertexLayerSupported())
+            shader = new Shader("shaders/depthShaderLayered.vs", nullptr);
+        else
+            shader = new Shader("shaders/depthShaderLayeredGs.vs", nullptr, "shaders/depthShaderLayered.gs");
+    }
+
+    // own vertex array, so the instance attributes do not leak into the other passes
+    GLint previousVao;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVao);
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, meshBuffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, meshStride, (void*)0);
+
+    glGenBuffers(1, &instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    for (int column = 0; column < 4; ++column)
+    {
+        glEnableVertexAttribArray(5 + column);
+        glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(LayerInstance), (void*)(offsetof(LayerInstance, model) + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(5 + column, 1);
+    }
+    glEnableVertexAttribArray(9);
+    glVertexAttribIPointer(9, 1, GL_UNSIGNED_INT, sizeof(LayerInstance), (void*)offsetof(LayerInstance, layer));
+    glVertexAttribDivisor(9, 1);
+
+    glBindVertexArray(previousVao);
+}
+
+LayeredDepthRenderer::~LayeredDepthRenderer()
+{
+    glDeleteBuffers(1, &instanceBuffer);
+    glDeleteVertexArrays(1, &vao);
+    delete shader;
+}
+
+void LayeredDepthRenderer::draw(const std::vector<LayerInstance>& instances)
+{
+    if (instances.empty())
+        return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    if (instances.size() > capacity)
+    {
+        capacity = instances.size() * 2;
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(LayerInstance), NULL, GL_STREAM_DRAW);
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(LayerInstance), instances.data());
+
+    GLint previousVao;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVao);
+    glBindVertexArray(vao);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 36, (GLsizei)instances.size());
+    glBindVertexArray(previousVao);
+}
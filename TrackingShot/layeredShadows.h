@@ -0,0 +1,46 @@
+#pragma once
+
+// Single pass layered depth rendering
+// every (object, layer) pair that survived the per layer culling becomes one instance of the cube mesh, so all
+// shadow layers are filled by one instanced draw call instead of one scene submission per layer.
+// the layer is written to gl_Layer from the vertex shader (ARB_shader_viewport_layer_array / AMD_vertex_shader_layer)
+// or, without those extensions, from a geometry shader.
+
+#include <GL/glew.h> // include glew before gl.h (from glfw3)
+
+#include <glm.hpp>
+
+#include <vector>
+
+#include "shader.h"
+
+// per instance vertex data, locations 5 - 8 (model) and 9 (layer) in the layered depth shaders
+struct LayerInstance
+{
+    glm::mat4 model;
+    GLuint layer; // or any other per instance target index the program understands (e.g. atlas tiles)
+};
+
+class LayeredDepthRenderer
+{
+public:
+    // true if gl_Layer can be written in the vertex shader, otherwise the geometry shader variant is used
+    static bool vertexLayerSupported();
+
+    // meshBuffer holds the cube mesh (36 vertices) with positions at location 0 and the given stride
+    // the program has no fragment stage, only depth is written
+    // program replaces the layered depth shaders (and is deleted with the renderer), it reads the same attributes
+    LayeredDepthRenderer(GLuint meshBuffer, GLsizei meshStride, Shader* program = nullptr);
+    ~LayeredDepthRenderer();
+
+    // program for draw, transforms with the cascadeLightSpace uniforms (see CascadedShadowMap::setUniforms)
+    Shader& program() { return *shader; }
+    // uploads the instances and draws them into the bound layered framebuffer, the program has to be in use
+    void draw(const std::vector<LayerInstance>& instances);
+
+private:
+    Shader* shader;
+    GLuint vao;
+    GLuint instanceBuffer;
+    size_t capacity; // number of instances the buffer can hold
+};
@@ -5,4 +5,7 @@
 struct Light {
     glm::vec3 position;
     glm::vec3 color;
+    // range of a point light, also the far plane of its cube shadow; 0 for the key light with the cascaded shadows
+    float radius = 0.0f;
+    bool castsShadow = false; // point lights with a cube shadow in the shadow atlas
 };
@@ -15,6 +15,9 @@
 // MODERN_OGL
 
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <limits>
 
 #define PI 3.14159 // ... TODO: away go stinky constant!
 
@@ -28,7 +31,24 @@
 #include "light.h"
 #include "spline.h"
 #include "world.h"
-#include "textureHandler.h"
+#include "renderable.h"
+#include "gpuCulling.h"
+#include "cpuCulling.h"
+#include "bvh.h"
+#include "pvs.h"
+#include "occlusionCulling.h"
+#include "benchmark.h"
+#include "shadowCache.h"
+#include "cascadedShadows.h"
+#include "layeredShadows.h"
+#include "shadowMoments.h"
+#include "pointShadows.h"
+#include "clusteredLights.h"
+#include "gBuffer.h"
+#include "tangentFrames.h"
+#include "shaderVariants.h"
+#include "shaderWatcher.h"
+#include "textureManager.h"
 
 #include "errorHandler.h" // use with GLCALL(glfunction());
 
@@ -37,16 +57,27 @@ void framebuffer_size_callback (GLFWwindow* window, int width, int height);
 void mouse_callback (GLFWwindow* window, double xpos, double ypos);
 void scroll_callback (GLFWwindow* window, double xoffset, double yoffset);
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void mouse_button_callback (GLFWwindow* window, int button, int action, int mods);
 void processInput (GLFWwindow* window);
-void renderScene (const Shader& shader);
+void collectRenderables ();
+void updateSceneBvh ();
+void cullRenderables (const glm::mat4& viewProjection, bool shadowPass, std::vector<unsigned int>& visible);
+void cullRenderablesPvs (const glm::mat4& viewProjection, unsigned int bucket, std::vector<unsigned int>& visible);
+int bakePvs ();
+void renderScene (const Shader& shader, const std::vector<unsigned int>& visible, Material material);
+std::vector<std::string> materialDefines (Material material);
+void setupLightingShader (Shader& shader);
+void setupGBufferShader (Shader& shader);
+void setupDeferredShader (Shader& shader);
+void renderDepth (const Shader& shader, const std::vector<unsigned int>& visible);
 
 GLFWwindow* window = nullptr;
 const GLint WIDTH = 800, HEIGHT = 600;
 bool multisampleEnabled = false;
 int SAMPLES = GLFW_DONT_CARE; // specifies GLFW_SAMPLES mode for GLFWwindow
-const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
-const float NEAR = 0.1f;
-const float FAR = 30.0f;
+const unsigned int SHADOW_SIZE = 384; // per cascade, CASCADE_COUNT cascades in total
+const float CAMERA_NEAR = 0.1f;
+const float CAMERA_FAR = 100.0f;
 
 // TODO: move to world
 Camera baseCamera(glm::vec3(0.0f, 20.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0, -90); // camera to overview scene
@@ -62,6 +93,71 @@ float camSpeed = SPEED;
 
 float bumpiness = 0.5f; // Bonus UE3: dynamic setting of bumpiness
 
+// scene objects of the current frame, rebuilt by collectRenderables
+std::vector<Renderable> renderables;
+CullingBounds renderableBounds; // bounds of renderables in SIMD friendly layout
+std::vector<unsigned int> shadowCasters; // indices of the renderables that cast a shadow, the only candidates of the depth pass
+CullingBounds shadowCasterBounds; // bounds of shadowCasters in SIMD friendly layout, index i belongs to shadowCasters[i]
+Aabb receiverBounds; // world space bounds of all renderables
+Aabb casterBounds; // world space bounds of the shadow casters, the cascades are clipped to both
+std::vector<unsigned int> visibleCamera, visibleShadow; // indices into renderables, result of the CPU culling
+std::vector<unsigned int> visibleShadowStatic, visibleShadowDynamic; // visibleShadow split for the cached shadow map
+std::vector<LayerInstance> shadowInstances, shadowInstancesDynamic; // culled casters of all cascades for the layered depth pass
+bool gpuCulling = true; // compute shader culling + indirect draws, only used if supported by the context
+Bvh sceneBvh; // spatial hierarchy over renderables, shared by culling, shadow caster selection and picking
+
+// CPU culling strategies used when the GPU path is not used
+enum Culling_Mode {
+    CULLING_OFF,
+    CULLING_SIMD, // linear AVX2 test of all bounds
+    CULLING_BVH, // hierarchical test over sceneBvh
+    CULLING_MODE_COUNT
+};
+const char* CULLING_MODE_NAMES[] = { "off", "SIMD", "BVH" };
+Culling_Mode cullingMode = CULLING_BVH;
+
+// shadow map filtering in lightingShader.fs, must match the SHADOW_FILTER_* constants there
+enum Shadow_Filter {
+    SHADOW_FILTER_HARDWARE, // one bilinear depth compare
+    SHADOW_FILTER_PCF, // 3x3 bilinear compares
+    SHADOW_FILTER_ADAPTIVE, // 4 compares, 3x3 only in penumbra regions
+    SHADOW_FILTER_VSM, // one fetch of the blurred variance shadow map
+    SHADOW_FILTER_EVSM, // one fetch of the blurred exponential variance shadow map
+    SHADOW_FILTER_COUNT
+};
+const char* SHADOW_FILTER_NAMES[] = { "hardware 2x2", "PCF 3x3", "adaptive PCF", "VSM", "EVSM" };
+const unsigned int MOMENTS_DOWNSAMPLE = 2; // (E)VSM moments are blurred at half the cascade resolution
+Shadow_Filter shadowFilter = SHADOW_FILTER_ADAPTIVE;
+// glPolygonOffset of the depth pass: slope factor and constant in smallest depth steps
+const float SHADOW_OFFSET_FACTOR = 2.0f;
+const float SHADOW_OFFSET_UNITS = 4.0f;
+const int PCF_KERNEL = 1; // radius of the PCF kernel in texels, compiled into the lighting shaders (1: 3x3 taps)
+
+// potentially visible sets along the camera path, baked offline with --bake-pvs and stored with the waypoints
+const char* PATH_FILE = "trackingShot.path";
+const unsigned int PVS_BUCKETS = 64; // arc length buckets along the whole path
+PathPvs pathPvs;
+bool pvsCulling = true; // use the baked sets for the camera pass in action mode
+bool shadowCaching = true; // static casters are kept in a cached depth map, only dynamic ones are drawn every frame
+bool layeredShadows = true; // all cascades in one instanced draw instead of one submission per cascade
+bool occlusionCulling = false; // hardware occlusion queries over sceneBvh for the camera pass when no PVS is used
+bool pointShadows = true; // cube shadows of the point lights, unshadowed point lights otherwise
+const unsigned int POINT_SHADOW_ATLAS_SIZE = 2048;
+std::vector<LayerInstance> pointShadowInstances; // culled casters of the faces of all stale point lights
+bool clusteredLighting = true; // fragments only loop over the lights of their cluster instead of all lights
+bool deferredShading = false; // G-buffer geometry pass and one fullscreen lighting pass instead of forward shading
+std::vector<unsigned int> staticIndices; // per renderable: index among the static renderables (object of the PVS) or BVH_NONE
+unsigned int staticCount = 0;
+std::vector<Aabb> staticBoxes; // bounds of the static renderables in the order of staticIndices
+uint64_t staticScene = 0; // PathPvs::sceneHash of the camera path and staticBoxes, the baked sets must match it
+const size_t TEXTURE_UPLOAD_BUDGET = 4 << 20; // bytes of decoded images uploaded per frame
+const size_t TEXTURE_MEMORY_BUDGET = 256 << 20; // bytes of all textures, least recently used mip levels are evicted above
+
+// benchmark mode, the base camera circles the scene once per configuration
+bool benchmarkMode = false;
+Benchmark benchmark;
+const float BENCHMARK_RADIUS = 14.0f, BENCHMARK_HEIGHT = 4.0f;
+
 // timing
 float deltaTime = 0.0f;	// time between current frame and last frame
 float lastFrame = 0.0f;
@@ -74,8 +170,17 @@ int exitWithError (std::string code)
 
 int createWindow ()
 {
+    // 4.3 core for the GPU culling (compute shaders, shader storage buffers), everything else runs on 3.3 core
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     window = glfwCreateWindow(WIDTH, HEIGHT, "TrackingShot", nullptr, nullptr);
     if (!window)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(WIDTH, HEIGHT, "TrackingShot", nullptr, nullptr);
+    }
+    if (!window)
     {
         glfwTerminate();
         return exitWithError("could not initialize glfw window");
@@ -89,6 +194,7 @@ int createWindow ()
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
     glfwSetKeyCallback(window, key_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
 
     // tell GLFW to capture our mouse
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -96,37 +202,13 @@ int createWindow ()
 
 int main (int argc, char** argv)
 {
-    // Initialize glfw library
-    if (!glfwInit())
-        return exitWithError("could not initialize glfw");
-
-    // Set all the required options for GLFW
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-    glfwWindowHint(GLFW_SAMPLES, SAMPLES); // defined samples for  GLFW Window: Zero disables multisampling, a value of GLFW_DONT_CARE means the application has no preference
-    //glfwOpenWindowHint(GLFW_FSAA_SAMPLES, 4); // used for OpenGL version 2
-    // could also use a custom Anti-Aliasing algorithm in the shader, multisampled texture attachments
-    //      https://learnopengl.com/Advanced-OpenGL/Anti-Aliasing
-
-    // Create a windowed mode window and its OpenGL context
-    createWindow();
-
-    // Set this to true so GLEW knows to use a modern approach to retrieving function pointers and extensions
-    glewExperimental = GL_TRUE;
-    // Initialize GLEW to setup the OpenGL Function pointers
-    GLenum err = glewInit();
-    if (GLEW_OK != err)
+    // load the camera path with its baked visible sets, otherwise add defined amount of waypoints to list
+    if (loadPathFile(PATH_FILE, cameraPath, pathPvs))
     {
-        glfwTerminate();
-        std::cout << glewGetErrorString(err) << std::endl;
-        return exitWithError("Failed to initialize GLEW");
+        std::cout << "loaded " << cameraPath.PositionsSize() << " waypoints and " << pathPvs.BucketCount() << " PVS buckets from " << PATH_FILE << std::endl;
+        camera.Position = cameraPath.Positions()[0].position;
     }
-
-    // add defined amount of waypoints to list
-    if (CONTROL_POINTS > 0)
+    else if (CONTROL_POINTS > 0)
     {
         float rad = 8.0f;
         float deg = (float)(2 * PI / CONTROL_POINTS);
@@ -156,12 +238,66 @@ int main (int argc, char** argv)
     // setup global light
     gLight.position = glm::vec3(0, 10, 0);
     gLight.color = glm::vec3(1, 1, 1); // white
+    // main is entered again when the multisample mode changes, the lights must not be added twice
+    lights.clear();
     lights.push_back(&gLight);
 
+    // colored point lights on a ring around the cubes
+    for (unsigned int i = 0; i < POINT_LIGHT_COUNT; ++i)
+    {
+        float angle = (float)(2 * PI * i / POINT_LIGHT_COUNT);
+        pointLights[i].position = glm::vec3(sin(angle) * 7.0f, 0.5f + (i % 2) * 2.5f, cos(angle) * 7.0f);
+        pointLights[i].color = 4.0f * glm::vec3(i % 3 == 0, i % 3 == 1, i % 3 == 2) + glm::vec3(1.0f);
+        pointLights[i].radius = 8.0f;
+        pointLights[i].castsShadow = true;
+        lights.push_back(&pointLights[i]);
+    }
+
+    // a grid of small lights over the ground, their height is animated every frame
+    for (unsigned int i = 0; i < SMALL_LIGHT_COUNT; ++i)
+    {
+        smallLights[i].position = glm::vec3(-18.0f + (i % 16 + 0.5f) * 2.25f, 0.0f, -18.0f + (i / 16 + 0.5f) * 2.25f);
+        smallLights[i].color = glm::vec3(0.5f + 0.5f * sin(i * 1.7f), 0.5f + 0.5f * sin(i * 2.3f + 2.0f), 0.5f + 0.5f * sin(i * 3.1f + 4.0f));
+        smallLights[i].radius = 2.5f;
+        lights.push_back(&smallLights[i]);
+    }
+
     // TODO: add another light -> emitting from camera
     //gLight.position = camera.position();
     //gLight.color = glm::vec3(1, 0, 0); // red
 
+    // offline bake of the path's visible sets, no window needed
+    if (argc > 1 && std::string(argv[1]) == "--bake-pvs")
+        return bakePvs();
+    benchmarkMode = (argc > 1 && std::string(argv[1]) == "--benchmark");
+
+    // Initialize glfw library
+    if (!glfwInit())
+        return exitWithError("could not initialize glfw");
+
+    // Set all the required options for GLFW, the context version is picked by createWindow
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+    glfwWindowHint(GLFW_SAMPLES, SAMPLES); // defined samples for  GLFW Window: Zero disables multisampling, a value of GLFW_DONT_CARE means the application has no preference
+    //glfwOpenWindowHint(GLFW_FSAA_SAMPLES, 4); // used for OpenGL version 2
+    // could also use a custom Anti-Aliasing algorithm in the shader, multisampled texture attachments
+    //      https://learnopengl.com/Advanced-OpenGL/Anti-Aliasing
+
+    // Create a windowed mode window and its OpenGL context
+    createWindow();
+
+    // Set this to true so GLEW knows to use a modern approach to retrieving function pointers and extensions
+    glewExperimental = GL_TRUE;
+    // Initialize GLEW to setup the OpenGL Function pointers
+    GLenum err = glewInit();
+    if (GLEW_OK != err)
+    {
+        glfwTerminate();
+        std::cout << glewGetErrorString(err) << std::endl;
+        return exitWithError("Failed to initialize GLEW");
+    }
+
 #ifdef MODERN_NO_SHADER
     // vertex data for modern open gl triangle
     float positions[6] = {
@@ -187,9 +323,64 @@ int main (int argc, char** argv)
     // UE4: enable multisampling
     glEnable(GL_MULTISAMPLE);
 
-    // build and compile shader programs
-    Shader shader("shaders/lightingShader.vs", "shaders/lightingShader.fs"); // actual shader for world objects
-    Shader depthShader("shaders/depthShader.vs", "shaders/depthShader.fs"); // depth shader to shadow map
+    // let the driver build the programs on as many threads as it likes, they are only waited for when used
+    if (GLEW_KHR_parallel_shader_compile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    else if (GLEW_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+    // build and compile shader programs, all of them are issued before any is used
+    // actual shaders for world objects: one permutation per material, see materialDefines
+    ShaderVariants lightingShaders("shaders/lightingShader.vs", "shaders/lightingShader.fs", setupLightingShader);
+    Shader depthShader("shaders/depthShader.vs", nullptr); // depth shader to shadow map, no fragment stage
+    // deferred path: the surface into the G-buffer, then lightingShader.fs once per pixel over a fullscreen triangle
+    ShaderVariants gBufferShaders("shaders/lightingShader.vs", "shaders/gBuffer.fs", setupGBufferShader);
+    ShaderVariants deferredShaders("shaders/deferredLighting.vs", "shaders/lightingShader.fs", setupDeferredShader);
+    std::vector<std::string> deferredDefines = materialDefines(MATERIAL_LIT);
+    deferredDefines.push_back("DEFERRED");
+    Shader fallbackShader("shaders/fallback.vs", "shaders/fallback.fs"); // flat colors while the above are compiling
+
+    // GPU culling: variants of the above that take model and color from the compacted instance buffer
+    GpuCuller* gpuCuller = nullptr;
+    ShaderVariants* lightingShadersIndirect = nullptr;
+    Shader* depthShaderIndirect = nullptr;
+    ShaderVariants* gBufferShadersIndirect = nullptr;
+    Shader* fallbackShaderIndirect = nullptr;
+    if (GpuCuller::isSupported())
+    {
+        gpuCuller = new GpuCuller();
+        lightingShadersIndirect = new ShaderVariants("shaders/lightingShaderIndirect.vs", "shaders/lightingShader.fs", setupLightingShader);
+        gBufferShadersIndirect = new ShaderVariants("shaders/lightingShaderIndirect.vs", "shaders/gBuffer.fs", setupGBufferShader);
+        depthShaderIndirect = new Shader("shaders/depthShaderIndirect.vs", nullptr);
+        fallbackShaderIndirect = new Shader("shaders/fallbackIndirect.vs", "shaders/fallback.fs");
+        lightingShadersIndirect->get(materialDefines(MATERIAL_LIT));
+        gBufferShadersIndirect->get(materialDefines(MATERIAL_LIT));
+    }
+    else
+    {
+        std::cout << "compute shaders not supported, drawing without GPU culling" << std::endl;
+        gpuCulling = false;
+    }
+    OcclusionCuller* occlusionCuller = new OcclusionCuller();
+    // the lit material is on screen from the first frame, its permutations are started right away, the others on first use
+    lightingShaders.get(materialDefines(MATERIAL_LIT));
+    gBufferShaders.get(materialDefines(MATERIAL_LIT));
+    deferredShaders.get(deferredDefines);
+
+    if (benchmarkMode)
+    {
+        // CPU culling in edit mode, so neither the GPU culling nor the path PVS hide the differences
+        glfwSwapInterval(0);
+        benchmark.addRun("BVH frustum culling", []() { editMode = true; gpuCulling = false; cullingMode = CULLING_BVH; occlusionCulling = false; shadowCaching = false; layeredShadows = false; shadowFilter = SHADOW_FILTER_PCF; pointShadows = false; clusteredLighting = true; deferredShading = false; });
+        benchmark.addRun("BVH frustum + occlusion culling", []() { occlusionCulling = true; });
+        benchmark.addRun("+ cached shadow map", []() { shadowCaching = true; });
+        benchmark.addRun("+ single pass layered shadows", []() { layeredShadows = true; });
+        benchmark.addRun("+ adaptive PCF", []() { shadowFilter = SHADOW_FILTER_ADAPTIVE; });
+        benchmark.addRun("+ EVSM instead of PCF", []() { shadowFilter = SHADOW_FILTER_EVSM; });
+        benchmark.addRun("+ cube shadows of the point lights", []() { pointShadows = true; });
+        benchmark.addRun("all lights per pixel instead of clusters", []() { clusteredLighting = false; });
+        benchmark.addRun("deferred shading", []() { clusteredLighting = true; deferredShading = true; });
+    }
 
     // ------------- UE3 normal mapping -------------------------------------------------------------------------------
     // used sources:
@@ -197,23 +388,16 @@ int main (int argc, char** argv)
     //      http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-13-normal-mapping/
     //      http://ogldev.atspace.co.uk/www/tutorial26/tutorial26.html
 
-    // init textures
-    unsigned int diffuseMap = loadTexture("textures/brickwall.jpg");
-    unsigned int normalMap = loadTexture("textures/brickwall_normal.jpg");
+    // init textures, decoded in the background: grey and a flat normal until they are uploaded
+    TextureManager* textureManager = new TextureManager(TEXTURE_MEMORY_BUDGET);
+    TextureHandle diffuseMap = textureManager->load("textures/brickwall.jpg");
+    TextureHandle normalMap = textureManager->load("textures/brickwall_normal.jpg", TEXTURE_NORMAL_MAP);
     //std::cout << "diffuseMap: " << diffuseMap << ", normalMap: " << normalMap << std::endl; // 1, 2
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, diffuseMap);
+    // units 1 and 2, bound every frame by the texture manager
     // UE4: may also use multisample textures
     //glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, diffuseMap);
     //glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, 16, GL_RGB, WIDTH, HEIGHT, GL_TRUE);
 
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, normalMap);
-
-    shader.use();
-    shader.setInt("shadowMap", 0);
-    shader.setInt("diffuseMap", 1);
-    shader.setInt("normalMap", 2);
     // ------------- UE3 normal mapping -------------------------------------------------------------------------------
 
     // ------------- UE2 shadow mapping -------------------------------------------------------------------------------
@@ -221,57 +405,68 @@ int main (int argc, char** argv)
     //      https://learnopengl.com/Advanced-Lighting/Shadows/Shadow-Mapping
     //      http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-16-shadow-mapping/
 
-    // framebuffer for rendering depthMap
-    unsigned int depthMapFBO;
-    glGenFramebuffers(1, &depthMapFBO);
+    // cascaded shadow maps: one depth layer per slice of the camera frustum, the lighting shader picks the layer per fragment
+    CascadedShadowMap* cascades = new CascadedShadowMap(SHADOW_SIZE);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, cascades->Texture());
 
-    // create depth texture
-    unsigned int depthMap;
-    glGenTextures(1, &depthMap);
+    // prefiltered moments of the cascades for the (E)VSM filters
+    ShadowMoments* shadowMoments = new ShadowMoments(SHADOW_SIZE, CASCADE_COUNT, MOMENTS_DOWNSAMPLE);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMoments->Texture());
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    float borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-    // attach depth texture as FBO's depth buffer
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // depth of the static casters per cascade, copied into the cascades every frame
+    ShadowCache* shadowCache = new ShadowCache(SHADOW_SIZE, CASCADE_COUNT);
     // ------------- UE2 shadow mapping -------------------------------------------------------------------------------
 
     unsigned int VBO, VAO;
     glGenVertexArrays(1, &VAO);
     glBindVertexArray(VAO);
 
+    // positions and uvs with tangent frames generated from the uv layout, the normal is part of the frame
+    std::vector<MeshVertex> meshVertices = buildTangentFrames(vertices, sizeof(vertices) / sizeof(vertices[0]) / 8);
     glGenBuffers(1, &VBO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     // fill buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, meshVertices.size() * sizeof(MeshVertex), meshVertices.data(), GL_STATIC_DRAW);
 
     // link vertex attributes
-    // position attribute
+    setMeshVertexAttributes();
+
+    // the depth passes only need positions: a tightly packed copy of them saves the fetch of uv and normal
+    std::vector<float> depthVertices;
+    for (size_t i = 0; i + 8 <= sizeof(vertices) / sizeof(vertices[0]); i += 8)
+        depthVertices.insert(depthVertices.end(), vertices + i, vertices + i + 3);
+    unsigned int depthVBO, depthVAO;
+    glGenVertexArrays(1, &depthVAO);
+    glBindVertexArray(depthVAO);
+    glGenBuffers(1, &depthVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, depthVBO);
+    glBufferData(GL_ARRAY_BUFFER, depthVertices.size() * sizeof(float), depthVertices.data(), GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    // texture coord attribute
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    // normal attribute
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_TRUE, 8 * sizeof(float), (void*)(5 * sizeof(float)));
-    /*
-    // tangent
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(8 * sizeof(float)));
-    // bitangent
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(11 * sizeof(float)));
-    */
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glBindVertexArray(VAO);
+
+    // instanced depth pass filling all cascades at once, reads the same position only buffer
+    LayeredDepthRenderer* layeredDepth = new LayeredDepthRenderer(depthVBO, 3 * sizeof(float));
+
+    // cube shadows of all point lights in one depth atlas, drawn from the same position only buffer
+    PointShadowAtlas* pointShadowAtlas = new PointShadowAtlas(POINT_SHADOW_ATLAS_SIZE, depthVBO, 3 * sizeof(float));
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, pointShadowAtlas->Texture());
+    glActiveTexture(GL_TEXTURE0);
+
+    // point lights per cluster of the view frustum, lights and cluster lists on units 6 - 8
+    LightClusters* lightClusters = new LightClusters();
+    lightClusters->bind(6);
+
+    // surface of the deferred path on units 9 - 11
+    GBuffer* gBuffer = new GBuffer(WIDTH, HEIGHT);
+    gBuffer->bind(9);
+
+    // edited shaders are rebuilt in the background and replace the running programs between two frames
+    ShaderWatcher* shaderWatcher = new ShaderWatcher("shaders");
 
     // spline interpolation for position and rotation
     size_t curWayPt = 0; // index of current waypoint to drive to
@@ -288,6 +483,10 @@ int main (int argc, char** argv)
         s = glm::distance(camera.Position, pt2.position); // total distance between current position end next waypoint
     }
 
+    // measured frames have their textures
+    if (benchmarkMode)
+        textureManager->finish();
+
     // Loop until the user closes the window
     while (!glfwWindowShouldClose(window))
     {
@@ -297,8 +496,32 @@ int main (int argc, char** argv)
         lastFrame = currentFrame;
         //std::cout << "delta time: " << deltaTime << std::endl;
 
+        // frame boundary: start rebuilding the programs of changed files, take the ones that are done
+        for (const std::string& file : shaderWatcher->changedFiles())
+            Shader::reloadDependents(file);
+        Shader::swapReloaded();
+        // texture objects change when they are loaded or lose mip levels, they are bound every frame
+        textureManager->update(TEXTURE_UPLOAD_BUDGET);
+        textureManager->bind(diffuseMap, 1);
+        textureManager->bind(normalMap, 2);
+
         processInput(window);
 
+        if (benchmarkMode)
+        {
+            if (!benchmark.isRunning())
+            {
+                benchmark.report();
+                break;
+            }
+            // look at the center from a circle around it
+            float angle = benchmark.beginFrame() * 2.0f * (float)PI;
+            baseCamera.Position = glm::vec3(cosf(angle) * BENCHMARK_RADIUS, BENCHMARK_HEIGHT, sinf(angle) * BENCHMARK_RADIUS);
+            baseCamera.Yaw = glm::degrees(atan2f(-baseCamera.Position.z, -baseCamera.Position.x));
+            baseCamera.Pitch = -glm::degrees(asinf(BENCHMARK_HEIGHT / glm::length(baseCamera.Position)));
+            baseCamera.ProcessMouseMovement(0, 0);
+        }
+
         float dist = glm::distance(camera.Position, cameraPath.Positions()[(curWayPt + 1) % cameraPath.PositionsSize()].position);
         if (t >= 1)
         {
@@ -331,6 +554,8 @@ int main (int argc, char** argv)
         // TODO make toggle for dynamic light position change
         gLight.position.x = (float)sin(currentFrame * camSpeed * 0.1) * 10.0f;
         gLight.position.z = (float)cos(currentFrame * camSpeed * 0.1) * 10.0f; // rotate around y
+        for (unsigned int i = 0; i < SMALL_LIGHT_COUNT; ++i)
+            smallLights[i].position.y = -1.0f + (i % 7) * 0.5f + 0.5f * (float)sin(currentFrame + i);
         //gLight.position.y = 10.0 + cos(currentFrame * camSpeed * 0.1) * 10.0f; // rotate around z
 
         // able to inc- / decrease radius
@@ -358,46 +583,298 @@ int main (int argc, char** argv)
         // ------------- UE2 shadow mapping -------------------------------------------------------------------------------
         // 1. render depth of scene to texture (from light's perspective)
         // --------------------------------------------------------------
-        glm::mat4 lightProjection, lightView, lightSpace;
-        //lightProjection = glm::perspective(glm::radians(45.0f), (GLfloat)SHADOW_WIDTH / (GLfloat)SHADOW_HEIGHT, NEAR, FAR); // note that if you use a perspective projection matrix you'll have to change the light position as the current light position isn't enough to reflect the whole scene
-        lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, NEAR, FAR);
-        lightView = glm::lookAt(gLight.position, glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
-        lightSpace = lightProjection * lightView;
+        // change camera mode (controlled by mouse or auto run)
+        Camera cam = (editMode) ? baseCamera : camera;
+        // pass projection matrix to shader (in this case it could change every frame)
+        glm::mat4 projection = glm::perspective(glm::radians(cam.Zoom), (float)WIDTH / (float)HEIGHT, CAMERA_NEAR, CAMERA_FAR);
+        glm::mat4 view = cam.GetViewMatrix();
+
+        // gather all objects and cull them against the camera frustum before any drawing, the cascades are culled one by one
+        collectRenderables();
+        updateSceneBvh();
+
+        // the light shines from its position towards the center, cascades are fitted to the camera frustum and the scene
+        // with the cache the shadows keep the light position until it moved far enough to render the static casters again,
+        // and the cascades keep the depth range of the scene, a range following the camera would make the cache useless
+        glm::vec3 shadowLight = (shadowCaching) ? shadowCache->trackLight(gLight.position) : gLight.position;
+        cascades->fit(view, cam.Zoom, (float)WIDTH / (float)HEIGHT, CAMERA_NEAR, CAMERA_FAR, -shadowLight, receiverBounds, casterBounds, shadowCaching);
+
+        bool indirect = gpuCuller && gpuCulling;
+        // the shadow pass of the GPU culling keeps the static and dynamic casters apart for the cached shadow map
+        bool indirectShadow = indirect;
+        // in action mode the camera pass only considers the baked visible set of the current path bucket, if it was baked for this scene
+        bool pvsActive = pvsCulling && !editMode && pathPvs.matches(staticScene);
+        // occlusion culling takes over where no PVS is available
+        bool occlusionActive = occlusionCulling && !pvsActive;
+        bool indirectCamera = indirect && !pvsActive && !occlusionActive;
+        if (indirect)
+            gpuCuller->upload(renderables);
+
+        if (indirectCamera)
+            gpuCuller->cull(CULL_CAMERA, projection * view);
+        else if (pvsActive)
+            cullRenderablesPvs(projection * view, pathPvs.bucketAt(curWayPt, t), visibleCamera);
+        else if (occlusionActive)
+        {
+            occlusionCuller->update(sceneBvh);
+            occlusionCuller->cull(sceneBvh, Frustum::fromMatrix(projection * view), cam.Position, visibleCamera);
+        }
+        else
+            cullRenderables(projection * view, false, visibleCamera);
+
         // render scene from light's point of view
-        depthShader.use();
-        depthShader.setMat4("lightSpace", lightSpace);
+        glViewport(0, 0, SHADOW_SIZE, SHADOW_SIZE);
+        // the near planes are fitted to the receivers, casters in front of them are flattened onto the near plane
+        glEnable(GL_DEPTH_CLAMP);
+        // slope scaled offset of the stored depth against shadow acne, replaces the slope part of the shader bias
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(SHADOW_OFFSET_FACTOR, SHADOW_OFFSET_UNITS);
+        glBindVertexArray(depthVAO);
+        bool layeredPass = layeredShadows && !indirectShadow;
+        if (layeredPass)
+        {
+            // cull every cascade, then draw the casters of all cascades in one submission
+            shadowInstances.clear();
+            shadowInstancesDynamic.clear();
+            for (unsigned int c = 0; c < CASCADE_COUNT; ++c)
+            {
+                const ShadowCascade& cascade = cascades->cascade(c);
+                // with the cache the static casters are only drawn into stale layers, culled against the whole layer
+                if (shadowCaching && shadowCache->isStale(c, cascade, staticCount))
+                {
+                    cullRenderables(shadowCache->beginUpdate(c, cascade, staticCount), true, visibleShadow);
+                    for (unsigned int i : visibleShadow)
+                    {
+                        if (!renderables[i].isDynamic)
+                            shadowInstances.push_back({ renderables[i].model, c });
+                    }
+                }
+                cullRenderables(cascade.lightSpace, true, visibleShadow);
+                for (unsigned int i : visibleShadow)
+                {
+                    if (!shadowCaching)
+                        shadowInstances.push_back({ renderables[i].model, c });
+                    else if (renderables[i].isDynamic)
+                        shadowInstancesDynamic.push_back({ renderables[i].model, c });
+                }
+            }
+
+            Shader& layeredShader = layeredDepth->program();
+            layeredShader.use();
+            if (shadowCaching)
+            {
+                if (!shadowInstances.empty())
+                {
+                    // the layers of the cache have their own light transforms
+                    for (unsigned int c = 0; c < CASCADE_COUNT; ++c)
+                        layeredShader.setMat4("cascadeLightSpace[" + std::to_string(c) + "]", shadowCache->lightSpace(c));
+                    shadowCache->bindLayered();
+                    layeredDepth->draw(shadowInstances);
+                }
+                // static depth plus the dynamic casters drawn on top
+                for (unsigned int c = 0; c < CASCADE_COUNT; ++c)
+                {
+                    cascades->bindCascade(c);
+                    shadowCache->restore(c, cascades->cascade(c), cascades->Framebuffer());
+                }
+                cascades->setUniforms(layeredShader);
+                cascades->bindLayered();
+                layeredDepth->draw(shadowInstancesDynamic);
+            }
+            else
+            {
+                cascades->setUniforms(layeredShader);
+                cascades->bindLayered();
+                glClear(GL_DEPTH_BUFFER_BIT);
+                layeredDepth->draw(shadowInstances);
+            }
+        }
+        else
+        {
+            // one submission per cascade, the indirect draws of the GPU culling only cover one light view
+            Shader& depthPassShader = (indirectShadow) ? *depthShaderIndirect : depthShader;
+            for (unsigned int c = 0; c < CASCADE_COUNT; ++c)
+            {
+                const ShadowCascade& cascade = cascades->cascade(c);
+                const glm::mat4& cascadeSpace = cascade.lightSpace;
+                if (shadowCaching && shadowCache->isStale(c, cascade, staticCount))
+                {
+                    // the static casters of the whole layer, it covers more than the cascade
+                    glm::mat4 cacheSpace = shadowCache->beginUpdate(c, cascade, staticCount);
+                    if (indirectShadow)
+                    {
+                        gpuCuller->cull(CULL_SHADOW, cacheSpace);
+                        depthPassShader.use();
+                        depthPassShader.setMat4("lightSpace", cacheSpace);
+                        gpuCuller->draw(SHADOW_STATIC, depthPassShader);
+                    }
+                    else
+                    {
+                        cullRenderables(cacheSpace, true, visibleShadow);
+                        visibleShadowStatic.clear();
+                        for (unsigned int i : visibleShadow)
+                        {
+                            if (!renderables[i].isDynamic)
+                                visibleShadowStatic.push_back(i);
+                        }
+                        depthShader.use();
+                        depthShader.setMat4("lightSpace", cacheSpace);
+                        renderDepth(depthShader, visibleShadowStatic);
+                    }
+                }
+
+                if (indirectShadow)
+                    gpuCuller->cull(CULL_SHADOW, cascadeSpace);
+                else
+                    cullRenderables(cascadeSpace, true, visibleShadow);
+                // the cull dispatch switched the program
+                depthPassShader.use();
+                depthPassShader.setMat4("lightSpace", cascadeSpace);
+                if (shadowCaching)
+                {
+                    // static depth plus the dynamic casters drawn on top
+                    cascades->bindCascade(c);
+                    shadowCache->restore(c, cascade, cascades->Framebuffer());
+                    if (indirectShadow)
+                        gpuCuller->draw(SHADOW_DYNAMIC, depthPassShader);
+                    else
+                    {
+                        visibleShadowDynamic.clear();
+                        for (unsigned int i : visibleShadow)
+                        {
+                            if (renderables[i].isDynamic)
+                                visibleShadowDynamic.push_back(i);
+                        }
+                        renderDepth(depthShader, visibleShadowDynamic);
+                    }
+                }
+                else
+                {
+                    cascades->bindCascade(c);
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                    if (indirectShadow)
+                        gpuCuller->draw(CULL_SHADOW, depthPassShader);
+                    else
+                        renderDepth(depthShader, visibleShadow);
+                }
+            }
+        }
+        glDisable(GL_DEPTH_CLAMP);
 
-        glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-        glClear(GL_DEPTH_BUFFER_BIT);
-        renderScene(depthShader);
+        // point light cube shadows: only lights that moved, got another tile or have moving casters in range are drawn
+        pointShadowAtlas->allocate(lights, cam.Position, cam.Zoom);
+        if (pointShadows)
+        {
+            pointShadowInstances.clear();
+            for (unsigned int slot = 0; slot < pointShadowAtlas->lightCount(); ++slot)
+            {
+                const Light& light = pointShadowAtlas->light(slot);
+                bool dynamicInRange = false;
+                for (unsigned int i : shadowCasters)
+                {
+                    const Renderable& caster = renderables[i];
+                    if (caster.isDynamic && glm::distance(glm::clamp(light.position, caster.boundsMin, caster.boundsMax), light.position) < light.radius)
+                        dynamicInRange = true;
+                }
+                if (!pointShadowAtlas->isStale(slot, staticCount, dynamicInRange))
+                    continue;
+
+                pointShadowAtlas->beginUpdate(slot, staticCount, dynamicInRange);
+                for (unsigned int face = 0; face < CUBE_FACES; ++face)
+                {
+                    cullRenderables(pointShadowAtlas->faceViewProjection(slot, face), true, visibleShadow);
+                    for (unsigned int i : visibleShadow)
+                        pointShadowInstances.push_back({ renderables[i].model, slot * CUBE_FACES + face });
+                }
+            }
+            glViewport(0, 0, POINT_SHADOW_ATLAS_SIZE, POINT_SHADOW_ATLAS_SIZE);
+            pointShadowAtlas->draw(pointShadowInstances);
+        }
+        else
+            pointShadowAtlas->invalidate();
+        glBindVertexArray(VAO);
+        glDisable(GL_POLYGON_OFFSET_FILL);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // point lights to the clusters of the camera, shadowed ones refer to their atlas slot
+        lightClusters->assign(lights, *pointShadowAtlas, view, cam.Zoom, (float)WIDTH / (float)HEIGHT, CAMERA_NEAR, CAMERA_FAR);
+
+        // variance filters: turn the finished depth into blurred moments
+        if (shadowFilter == SHADOW_FILTER_VSM || shadowFilter == SHADOW_FILTER_EVSM)
+            shadowMoments->update(cascades->Texture(), shadowFilter == SHADOW_FILTER_EVSM);
         // ------------- UE2 shadow mapping -------------------------------------------------------------------------------
 
         // ------------- UE2 shadow mapping -------------------------------------------------------------------------------
         // 2. render scene as normal using the generated depth/shadow map
         // --------------------------------------------------------------
-        glViewport(0, 0, WIDTH, HEIGHT);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        shader.use();
-        // dynamically allow to set bumpiness
-        shader.setFloat("bumpiness", bumpiness);
-
-        // change camera mode (controlled by mouse or auto run)
-        Camera cam = (editMode) ? baseCamera : camera;
-        // pass projection matrix to shader (in this case it could change every frame)
-        glm::mat4 projection = glm::perspective(glm::radians(cam.Zoom), (float)WIDTH / (float)HEIGHT, 0.1f, 100.0f);
-        shader.setMat4("projection", projection);
-
-        // camera/view transformation
-        shader.setMat4("view", cam.GetViewMatrix());
+        // deferred: the same draws fill the G-buffer, the lights are applied afterwards in one fullscreen pass
+        Shader* deferredPassShader = (deferredShading) ? deferredShaders.ready(deferredDefines) : nullptr;
+        if (deferredPassShader)
+            gBuffer->begin();
+        else
+        {
+            glViewport(0, 0, WIDTH, HEIGHT);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
 
         // set light uniforms
-        shader.setVec3("viewPos", cam.Position);
-        shader.setMat4("lightSpace", lightSpace);
-        shader.setVec3("light.position", gLight.position);
-        shader.setVec3("light.color", gLight.color);
-        renderScene(shader);
+        auto setLightUniforms = [&](Shader& lightingPassShader) {
+            lightingPassShader.setVec3("viewPos", cam.Position);
+            cascades->setUniforms(lightingPassShader);
+            lightingPassShader.setInt("shadowFilter", shadowFilter);
+            pointShadowAtlas->setUniforms(lightingPassShader, pointShadows);
+            lightClusters->setUniforms(lightingPassShader, WIDTH, HEIGHT);
+            lightingPassShader.setBool("clusteredLighting", clusteredLighting);
+            lightingPassShader.setVec3("light.position", gLight.position);
+            lightingPassShader.setVec3("light.color", gLight.color);
+        };
+
+        // every material with its own permutation, the flat fallback while that one is still compiling;
+        // the GPU culling sorts the visible objects by material, so its draws use the same permutations
+        ShaderVariants* scenePassVariants = (deferredPassShader) ? ((indirectCamera) ? gBufferShadersIndirect : &gBufferShaders)
+            : ((indirectCamera) ? lightingShadersIndirect : &lightingShaders);
+        for (int material = 0; material < MATERIAL_COUNT; ++material)
+        {
+            Shader* scenePassShader = scenePassVariants->ready(materialDefines((Material)material));
+            if (!scenePassShader)
+                scenePassShader = (indirectCamera) ? fallbackShaderIndirect : &fallbackShader;
+            scenePassShader->use();
+            if (!deferredPassShader && material != MATERIAL_UNLIT)
+                setLightUniforms(*scenePassShader);
+            // dynamically allow to set bumpiness
+            scenePassShader->setFloat("bumpiness", bumpiness);
+
+            scenePassShader->setMat4("projection", projection);
+
+            // camera/view transformation
+            scenePassShader->setMat4("view", view);
+
+            if (indirectCamera)
+                gpuCuller->draw(CULL_CAMERA, (Material)material, *scenePassShader);
+            else
+                renderScene(*scenePassShader, visibleCamera, (Material)material);
+        }
+        // test the hidden nodes against the finished depth buffer, results are used in one of the next frames
+        if (occlusionActive)
+        {
+            glBindVertexArray(depthVAO);
+            occlusionCuller->issueQueries(sceneBvh, depthShader, projection * view);
+            glBindVertexArray(VAO);
+        }
+
+        // deferred lighting: every covered pixel once, with the light lists of its cluster
+        if (deferredPassShader)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            deferredPassShader->use();
+            setLightUniforms(*deferredPassShader);
+            deferredPassShader->setMat4("view", view);
+            deferredPassShader->setMat4("inverseViewProjection", glm::inverse(projection * view));
+            glDisable(GL_DEPTH_TEST);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glEnable(GL_DEPTH_TEST);
+        }
         // ------------- UE2 shadow mapping -------------------------------------------------------------------------------
 
         // Swap front and back buffers
@@ -405,19 +882,48 @@ int main (int argc, char** argv)
 
         // Poll for and process events
         glfwPollEvents();
+
+        if (benchmarkMode)
+        {
+            benchmark.countObjects(visibleCamera.size());
+            benchmark.endFrame();
+        }
     }
 
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
+    glDeleteVertexArrays(1, &depthVAO);
+    glDeleteBuffers(1, &depthVBO);
+    delete gpuCuller;
+    delete lightingShadersIndirect;
+    delete depthShaderIndirect;
+    delete gBufferShadersIndirect;
+    delete fallbackShaderIndirect;
+    delete occlusionCuller;
+    delete shadowCache;
+    delete cascades;
+    delete layeredDepth;
+    delete shadowMoments;
+    delete pointShadowAtlas;
+    delete lightClusters;
+    delete gBuffer;
+    delete shaderWatcher;
+    // the handles go before their manager
+    diffuseMap = TextureHandle();
+    normalMap = TextureHandle();
+    delete textureManager;
 
     glfwTerminate();
     return EXIT_SUCCESS;
 }
 
-// renders all scene models with the given shader
-void renderScene (const Shader &shader)
+// builds the list of all scene objects with their model matrices and bounds for the current frame
+void collectRenderables ()
 {
-    // calculate the model matrix for each object and pass it to shader before drawing
+    renderables.clear();
+    renderableBounds.clear();
+
+    // calculate the model matrix for each object
     glm::mat4 model = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
     //---------------------------------------------------------------------------------------------------------
     // render a cube for floating camera
@@ -427,10 +933,7 @@ void renderScene (const Shader &shader)
         model = glm::scale(model, glm::vec3(0.5f));
         model *= glm::toMat4(camera.Rotation); // rotate by quaternion
 
-        shader.setMat4("model", model);
-        shader.setVec4("color", glm::vec4(1, 0, 1, 1));
-
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        renderables.push_back(makeRenderable(model, glm::vec4(1, 0, 1, 1), true, true));
     }
 
     //---------------------------------------------------------------------------------------------------------
@@ -438,32 +941,25 @@ void renderScene (const Shader &shader)
     model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(0, -2, 0));
     model = glm::scale(model, glm::vec3(20, 0.1, 20));
-    shader.setMat4("model", model);
-    shader.setVec4("color", glm::vec4(0, 1, 0, 1));
-
-    glDrawArrays(GL_TRIANGLES, 0, 36);
+    renderables.push_back(makeRenderable(model, glm::vec4(0, 1, 0, 1)));
 
     //---------------------------------------------------------------------------------------------------------
     // render the sun \ [T] /
-    //std::cout << "shader ID: " << shader.ID << std::endl;
-    if (shader.ID != 6) // no depth map for light sources
+    for (auto light : lights)
     {
-        for (auto light : lights)
-        {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, light->position);
-            model = glm::scale(model, glm::vec3(0.2f));
-            shader.setMat4("model", model);
-            shader.setVec4("color", glm::vec4(1, 1, 1, 1));
-
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-            // TODO: would be nice to drawSphere(model);
-        }
+        // the small lights are too many for markers
+        if (light->radius > 0.0f && !light->castsShadow)
+            continue;
+        model = glm::mat4(1.0f);
+        model = glm::translate(model, light->position);
+        model = glm::scale(model, glm::vec3(0.2f));
+        renderables.push_back(makeRenderable(model, glm::vec4(1, 1, 1, 1), false, true, MATERIAL_UNLIT)); // no depth map for light sources
+        // TODO: would be nice to drawSphere(model);
     }
 
     //--------------------------------------------------------------------------------------------------------
     // render waypoints
-    std::vector<CameraWaypoint> camPos = cameraPath.Positions();
+    std::vector<CameraWaypoint>& camPos = cameraPath.Positions();
     for (size_t i = 0; i < camPos.size(); ++i)
     {
         model = glm::mat4(1.0f);
@@ -472,10 +968,7 @@ void renderScene (const Shader &shader)
         // rotate by fixed rad
         float deg = (float)(2 * PI / CONTROL_POINTS);
         model = glm::rotate(model, -deg * i, glm::vec3(0.0f, 1.0f, 0.0f));
-        shader.setMat4("model", model);
-        shader.setVec4("color", glm::vec4(1, 0, 0, 1));
-
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        renderables.push_back(makeRenderable(model, glm::vec4(1, 0, 0, 1)));
     }
 
     //--------------------------------------------------------------------------------------------------------
@@ -486,13 +979,216 @@ void renderScene (const Shader &shader)
         model = glm::mat4(1.0f);
         model = glm::translate(model, cubePositions[i]);
         model = glm::rotate(model, glm::radians(20.0f * i), glm::vec3(1.0f, 0.3f, 0.5f));
-        shader.setMat4("model", model);
-        shader.setVec4("color", glm::vec4(0, 0, 1, 1));
+        renderables.push_back(makeRenderable(model, glm::vec4(0, 0, 1, 1)));
+    }
+
+    staticIndices.resize(renderables.size());
+    staticCount = 0;
+    staticBoxes.clear();
+    shadowCasters.clear();
+    shadowCasterBounds.clear();
+    receiverBounds = { glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()) };
+    casterBounds = receiverBounds;
+    for (size_t i = 0; i < renderables.size(); ++i)
+    {
+        renderableBounds.add(renderables[i].boundsMin, renderables[i].boundsMax);
+        receiverBounds.boundsMin = glm::min(receiverBounds.boundsMin, renderables[i].boundsMin);
+        receiverBounds.boundsMax = glm::max(receiverBounds.boundsMax, renderables[i].boundsMax);
+        if (renderables[i].castsShadow)
+        {
+            shadowCasters.push_back((unsigned int)i);
+            shadowCasterBounds.add(renderables[i].boundsMin, renderables[i].boundsMax);
+            casterBounds.boundsMin = glm::min(casterBounds.boundsMin, renderables[i].boundsMin);
+            casterBounds.boundsMax = glm::max(casterBounds.boundsMax, renderables[i].boundsMax);
+        }
+        staticIndices[i] = (renderables[i].isDynamic) ? BVH_NONE : staticCount++;
+        if (!renderables[i].isDynamic)
+            staticBoxes.push_back({ renderables[i].boundsMin, renderables[i].boundsMax });
+    }
+    staticScene = PathPvs::sceneHash(cameraPath, staticBoxes);
+}
+
+// keeps sceneBvh in sync with renderables: rebuilt when objects were added or removed, otherwise only the moving ones are refit
+void updateSceneBvh ()
+{
+    if (sceneBvh.size() != renderables.size())
+    {
+        std::vector<Aabb> boxes(renderables.size());
+        std::vector<unsigned int> flags(renderables.size());
+        for (size_t i = 0; i < renderables.size(); ++i)
+        {
+            boxes[i] = { renderables[i].boundsMin, renderables[i].boundsMax };
+            flags[i] = renderableFlags(renderables[i]);
+        }
+        sceneBvh.build(boxes, flags);
+        return;
+    }
+
+    for (unsigned int i = 0; i < renderables.size(); ++i)
+    {
+        if (renderables[i].isDynamic)
+            sceneBvh.refit(i, { renderables[i].boundsMin, renderables[i].boundsMax });
+    }
+}
+
+// fills visible with the indices of all renderables inside the frustum of viewProjection
+// the shadow pass only considers the shadow casters
+void cullRenderables (const glm::mat4& viewProjection, bool shadowPass, std::vector<unsigned int>& visible)
+{
+    visible.clear();
+    // casters in front of a light view still throw shadows into it (depth clamp), only its sides and back cull
+    Frustum frustum = Frustum::fromMatrix(viewProjection);
+    if (shadowPass)
+        frustum.ignoreNearPlane();
+
+    if (cullingMode == CULLING_BVH)
+    {
+        // the hierarchy skips subtrees without casters on its own
+        sceneBvh.queryFrustum(frustum, shadowPass ? RENDERABLE_CASTS_SHADOW : 0, visible);
+        return;
+    }
+
+    if (shadowPass)
+    {
+        if (cullingMode == CULLING_SIMD)
+        {
+            // the caster bounds are indexed by caster, map back to renderables
+            cullFrustum(frustum, shadowCasterBounds, visible);
+            for (unsigned int& i : visible)
+                i = shadowCasters[i];
+        }
+        else
+            visible = shadowCasters;
+        return;
+    }
+
+    if (cullingMode == CULLING_SIMD)
+    {
+        cullFrustum(frustum, renderableBounds, visible);
+    }
+    else
+    {
+        for (unsigned int i = 0; i < renderables.size(); ++i)
+            visible.push_back(i);
+    }
+}
+
+// camera pass culling with the visible sets of the camera path: static renderables outside the set of bucket are
+// skipped without any test, dynamic ones are always tested against the frustum
+void cullRenderablesPvs (const glm::mat4& viewProjection, unsigned int bucket, std::vector<unsigned int>& visible)
+{
+    visible.clear();
+    Frustum frustum = Frustum::fromMatrix(viewProjection);
+    for (unsigned int i = 0; i < renderables.size(); ++i)
+    {
+        if (staticIndices[i] != BVH_NONE && !pathPvs.isVisible(bucket, staticIndices[i]))
+            continue;
+        if (frustum.intersects(renderables[i].boundsMin, renderables[i].boundsMax))
+            visible.push_back(i);
+    }
+}
+
+// bakes the visible sets of cameraPath against the static scene and writes them with the waypoints to PATH_FILE
+int bakePvs ()
+{
+    // the scene as seen in action mode, only static objects occlude and are part of the sets
+    editMode = false;
+    collectRenderables();
+    const std::vector<Aabb>& boxes = staticBoxes;
+    Bvh staticBvh;
+    staticBvh.build(boxes, std::vector<unsigned int>(boxes.size(), 0));
+    // the bounds of a rotated object cover more than the object, only the box inside it may hide others
+    std::vector<Aabb> innerBoxes;
+    for (const Renderable& renderable : renderables)
+    {
+        if (renderable.isDynamic)
+            continue;
+        Aabb inner;
+        innerBounds(renderable, inner.boundsMin, inner.boundsMax);
+        innerBoxes.push_back(inner);
+    }
+    Bvh occluderBvh;
+    occluderBvh.build(innerBoxes, std::vector<unsigned int>(innerBoxes.size(), 0));
+
+    std::cout << "baking PVS for " << cameraPath.PositionsSize() << " waypoints, " << boxes.size() << " objects, " << PVS_BUCKETS << " buckets" << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    pathPvs.bake(cameraPath, staticBvh, occluderBvh, PVS_BUCKETS, 0);
+    std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+
+    size_t total = 0;
+    for (unsigned int bucket = 0; bucket < pathPvs.BucketCount(); ++bucket)
+        total += pathPvs.visibleCount(bucket);
+    std::cout << "baked in " << elapsed.count() << "s, on average " << (float)total / pathPvs.BucketCount() << " of " << boxes.size() << " objects visible per bucket" << std::endl;
+
+    if (!savePathFile(PATH_FILE, cameraPath, pathPvs))
+        return exitWithError("could not write path file");
+    std::cout << "saved " << PATH_FILE << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// renders the given collected scene models of material with the given shader
+void renderScene (const Shader &shader, const std::vector<unsigned int>& visible, Material material)
+{
+    for (unsigned int i : visible)
+    {
+        const Renderable& renderable = renderables[i];
+        if (renderable.material != material)
+            continue;
+        shader.setMat4("model", renderable.model);
+        shader.setMat3("normalMatrix", renderable.normalMatrix);
+        shader.setVec4("color", renderable.color);
 
         glDrawArrays(GL_TRIANGLES, 0, 36);
     }
 }
 
+// the cheapest permutation of lightingShader.fs / gBuffer.fs that shades material, see shaderVariants.h
+std::vector<std::string> materialDefines (Material material)
+{
+    if (material == MATERIAL_UNLIT)
+        return { "UNLIT" };
+    return { "SHADOWS", "NORMAL_MAP", "PCF_KERNEL " + std::to_string(PCF_KERNEL) };
+}
+
+// sampler units of the lighting shader permutations, called once per permutation when it is built
+void setupLightingShader (Shader& shader)
+{
+    shader.use();
+    shader.setInt("shadowMap", 0);
+    shader.setInt("diffuseMap", 1);
+    shader.setInt("normalMap", 2);
+    shader.setInt("momentsMap", 3);
+    shader.setInt("pointShadowAtlas", 5);
+    shader.setInt("lightData", 6);
+    shader.setInt("clusterRanges", 7);
+    shader.setInt("clusterLights", 8);
+}
+
+void setupGBufferShader (Shader& shader)
+{
+    shader.use();
+    shader.setInt("diffuseMap", 1);
+    shader.setInt("normalMap", 2);
+}
+
+void setupDeferredShader (Shader& shader)
+{
+    setupLightingShader(shader);
+    shader.setInt("gAlbedo", 9 + GBUFFER_ALBEDO);
+    shader.setInt("gNormal", 9 + GBUFFER_NORMAL);
+    shader.setInt("gDepth", 9 + GBUFFER_DEPTH);
+}
+
+// renders the given collected scene models into a depth map, only the transform is needed
+void renderDepth (const Shader& shader, const std::vector<unsigned int>& visible)
+{
+    for (unsigned int i : visible)
+    {
+        shader.setMat4("model", renderables[i].model);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+    }
+}
+
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
 void processInput(GLFWwindow* window)
@@ -596,6 +1292,25 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
     baseCamera.ProcessMouseMovement(xoffset, yoffset);
 }
 
+// glfw: whenever a mouse button is pressed, this callback is called
+// picks the object in the center of the base camera's view in edit mode
+// -------------------------------------------------------
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+    if (!editMode || button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS)
+        return;
+
+    float distance;
+    unsigned int picked = sceneBvh.raycast(baseCamera.Position, baseCamera.Front, distance);
+    if (picked == BVH_NONE)
+    {
+        std::cout << "picked nothing" << std::endl;
+        return;
+    }
+    glm::vec3 position(renderables[picked].model[3]);
+    std::cout << "picked object #" << picked << " at " << glm::to_string(position) << " (distance " << distance << ")" << std::endl;
+}
+
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
 // ----------------------------------------------------------------------
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
@@ -611,7 +1326,57 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     if (action == GLFW_PRESS)
     {
         //std::cout << "key press callback for " << key << std::endl;
-        if (key == GLFW_KEY_F1)
+        if (key == GLFW_KEY_C)
+        {
+            cullingMode = (Culling_Mode)((cullingMode + 1) % CULLING_MODE_COUNT);
+            std::cout << "CPU culling: " << CULLING_MODE_NAMES[cullingMode] << std::endl;
+        }
+        else if (key == GLFW_KEY_P)
+        {
+            shadowFilter = (Shadow_Filter)((shadowFilter + 1) % SHADOW_FILTER_COUNT);
+            std::cout << "shadow filter: " << SHADOW_FILTER_NAMES[shadowFilter] << std::endl;
+        }
+        else if (key == GLFW_KEY_F)
+        {
+            deferredShading = !deferredShading;
+            std::cout << "deferred shading " << (deferredShading ? "enabled" : "disabled") << std::endl;
+        }
+        else if (key == GLFW_KEY_J)
+        {
+            clusteredLighting = !clusteredLighting;
+            std::cout << "clustered lighting " << (clusteredLighting ? "enabled" : "disabled") << std::endl;
+        }
+        else if (key == GLFW_KEY_H)
+        {
+            pointShadows = !pointShadows;
+            std::cout << "point light shadows " << (pointShadows ? "enabled" : "disabled") << std::endl;
+        }
+        else if (key == GLFW_KEY_L)
+        {
+            layeredShadows = !layeredShadows;
+            std::cout << "single pass layered shadows " << (layeredShadows ? "enabled" : "disabled") << std::endl;
+        }
+        else if (key == GLFW_KEY_K)
+        {
+            shadowCaching = !shadowCaching;
+            std::cout << "shadow map cache " << (shadowCaching ? "enabled" : "disabled") << std::endl;
+        }
+        else if (key == GLFW_KEY_O)
+        {
+            occlusionCulling = !occlusionCulling;
+            std::cout << "occlusion culling " << (occlusionCulling ? "enabled" : "disabled") << std::endl;
+        }
+        else if (key == GLFW_KEY_V)
+        {
+            pvsCulling = !pvsCulling;
+            std::cout << "path PVS culling " << (pvsCulling ? "enabled" : "disabled") << std::endl;
+        }
+        else if (key == GLFW_KEY_G)
+        {
+            gpuCulling = !gpuCulling;
+            std::cout << "GPU culling " << (gpuCulling ? "enabled" : "disabled") << std::endl;
+        }
+        else if (key == GLFW_KEY_F1)
         {
             if (multisampleEnabled)
             {
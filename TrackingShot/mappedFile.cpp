@@ -0,0 +1,69 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mappedFile.h"
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) : mapping(NULL), data(nullptr), size(0)
+{
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    LARGE_INTEGER fileSize;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        return;
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+        return;
+    data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data != nullptr)
+        size = (size_t)fileSize.QuadPart;
+}
+
+MappedFile::~MappedFile()
+{
+    if (data != nullptr)
+        UnmapViewOfFile(data);
+    if (mapping != NULL)
+        CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) : data(nullptr), size(0)
+{
+    int descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0)
+        return;
+    struct stat status;
+    if (fstat(descriptor, &status) == 0 && status.st_size > 0)
+    {
+        void* view = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (view != MAP_FAILED)
+        {
+            data = (const unsigned char*)view;
+            size = (size_t)status.st_size;
+            // the file is read front to back
+            madvise(view, size, MADV_SEQUENTIAL);
+        }
+    }
+    // the mapping stays valid without the descriptor
+    close(descriptor);
+}
+
+MappedFile::~MappedFile()
+{
+    if (data != nullptr)
+        munmap((void*)data, size);
+}
+
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+
+// read only view of a whole file through the virtual memory system (mmap / MapViewOfFile), the pages are read
+// when they are touched instead of being copied through a stream buffer first
+
+#include <cstddef>
+#include <string>
+
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // nullptr if the file could not be opened or is empty
+    const unsigned char* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+#ifdef _WIN32
+    // windows.h stays in the .cpp, its min / max macros break std::min / std::max in the files including this one
+    void* file; // HANDLE
+    void* mapping; // HANDLE
+#endif
+    const unsigned char* data;
+    size_t size;
+};
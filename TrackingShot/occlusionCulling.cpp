@@ -0,0 +1,211 @@
+#include <gtc/matrix_transform.hpp>
+
+#include "occlusionCulling.h"
+
+// frames after which a query result is waited for instead of polled
+const unsigned int MAX_QUERY_LATENCY = 2;
+// visible leaves are queried again only every few frames, spread over the frames by node index
+const unsigned int VISIBLE_QUERY_INTERVAL = 4;
+// nodes closer to the eye than this are treated as visible, their boxes would be clipped by the near plane
+const float NEAR_MARGIN = 0.5f;
+// query boxes are enlarged a bit so they are not hidden by the faces of the objects they enclose
+const float BOX_SCALE = 1.01f;
+// the build bounds the depth of the bvh, a depth first traversal holds at most one pending sibling per level
+const unsigned int STACK_SIZE = BVH_MAX_DEPTH + 1;
+
+OcclusionCuller::OcclusionCuller() : itemCount(0), frame(0)
+{
+    // GL 4.3 / ARB_ES3_compatibility allow the faster conservative variant, ANY_SAMPLES_PASSED is core in 3.3
+    target = (GLEW_ARB_ES3_compatibility) ? GL_ANY_SAMPLES_PASSED_CONSERVATIVE : GL_ANY_SAMPLES_PASSED;
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+    for (const NodeState& state : states)
+    {
+        if (state.query)
+            glDeleteQueries(1, &state.query);
+    }
+    if (!freeQueries.empty())
+        glDeleteQueries((GLsizei)freeQueries.size(), freeQueries.data());
+}
+
+void OcclusionCuller::reset(const Bvh& bvh)
+{
+    for (const NodeState& state : states)
+    {
+        if (state.query)
+            freeQueries.push_back(state.query);
+    }
+    pending.clear();
+    toQuery.clear();
+
+    // everything starts visible, the first queries remove what is hidden
+    states.resize(bvh.nodeCount());
+    for (unsigned int i = 0; i < states.size(); ++i)
+        states[i] = { 0, frame - i % VISIBLE_QUERY_INTERVAL, true };
+    itemCount = bvh.size();
+}
+
+void OcclusionCuller::setSubtreeVisible(const Bvh& bvh, unsigned int nodeIndex)
+{
+    // the children of a node that was hidden have no valid state, so they are assumed visible until queried
+    unsigned int stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = nodeIndex;
+    while (top > 0)
+    {
+        unsigned int index = stack[--top];
+        states[index].visible = true;
+        const BvhNode& node = bvh.node(index);
+        if (node.count == 0)
+        {
+            stack[top++] = node.leftFirst;
+            stack[top++] = node.leftFirst + 1;
+        }
+    }
+}
+
+void OcclusionCuller::update(const Bvh& bvh)
+{
+    ++frame;
+    if (states.size() != bvh.nodeCount() || itemCount != bvh.size())
+        reset(bvh);
+
+    size_t kept = 0;
+    for (unsigned int nodeIndex : pending)
+    {
+        NodeState& state = states[nodeIndex];
+        GLuint available = GL_TRUE;
+        if (frame - state.queryFrame < MAX_QUERY_LATENCY)
+            glGetQueryObjectuiv(state.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            pending[kept++] = nodeIndex;
+            continue;
+        }
+
+        GLuint passed;
+        glGetQueryObjectuiv(state.query, GL_QUERY_RESULT, &passed);
+        freeQueries.push_back(state.query);
+        state.query = 0;
+
+        if (!passed)
+        {
+            state.visible = false;
+            continue;
+        }
+        if (!state.visible)
+            setSubtreeVisible(bvh, nodeIndex);
+        // pull up: all nodes above a visible one are visible
+        for (unsigned int parent = bvh.node(nodeIndex).parent; parent != BVH_NONE; parent = bvh.node(parent).parent)
+            states[parent].visible = true;
+    }
+    pending.resize(kept);
+
+    // pull up: an inner node is hidden once both children are, children are always stored after their parent
+    for (unsigned int i = (unsigned int)states.size(); i-- > 0;)
+    {
+        const BvhNode& node = bvh.node(i);
+        if (node.count == 0 && states[i].visible)
+            states[i].visible = states[node.leftFirst].visible || states[node.leftFirst + 1].visible;
+    }
+}
+
+void OcclusionCuller::cull(const Bvh& bvh, const Frustum& frustum, const glm::vec3& eye, std::vector<unsigned int>& visible)
+{
+    visible.clear();
+    toQuery.clear();
+    if (bvh.size() == 0)
+        return;
+
+    unsigned int stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        unsigned int nodeIndex = stack[--top];
+        const BvhNode& node = bvh.node(nodeIndex);
+        if (!frustum.intersects(node.boundsMin, node.boundsMax))
+            continue;
+
+        NodeState& state = states[nodeIndex];
+        glm::vec3 closest = glm::clamp(eye, node.boundsMin, node.boundsMax);
+        if (glm::distance(closest, eye) < NEAR_MARGIN)
+        {
+            if (!state.visible)
+                setSubtreeVisible(bvh, nodeIndex);
+        }
+        else if (!state.visible)
+        {
+            // hidden last time: only query it, the subtree is skipped until the result says otherwise
+            if (!state.query)
+                toQuery.push_back(nodeIndex);
+            continue;
+        }
+        else if (node.count > 0 && !state.query && frame - state.queryFrame >= VISIBLE_QUERY_INTERVAL)
+            toQuery.push_back(nodeIndex);
+
+        if (node.count > 0)
+        {
+            for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+            {
+                unsigned int item = bvh.itemAt(i);
+                const Aabb& box = bvh.bounds(item);
+                if (frustum.intersects(box.boundsMin, box.boundsMax))
+                    visible.push_back(item);
+            }
+            continue;
+        }
+
+        // push the farther child first so the closer one is traversed first
+        const BvhNode& left = bvh.node(node.leftFirst);
+        const BvhNode& right = bvh.node(node.leftFirst + 1);
+        float leftDistance = glm::distance(eye, (left.boundsMin + left.boundsMax) * 0.5f);
+        float rightDistance = glm::distance(eye, (right.boundsMin + right.boundsMax) * 0.5f);
+        bool leftFirst = leftDistance <= rightDistance;
+        stack[top++] = leftFirst ? node.leftFirst + 1 : node.leftFirst;
+        stack[top++] = leftFirst ? node.leftFirst : node.leftFirst + 1;
+    }
+}
+
+void OcclusionCuller::issueQueries(const Bvh& bvh, Shader& boxShader, const glm::mat4& viewProjection)
+{
+    if (toQuery.empty())
+        return;
+
+    // boxes only test against the depth buffer, they must not show up or occlude anything themselves
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glDepthFunc(GL_LEQUAL);
+    boxShader.use();
+    boxShader.setMat4("lightSpace", viewProjection);
+
+    for (unsigned int nodeIndex : toQuery)
+    {
+        NodeState& state = states[nodeIndex];
+        if (freeQueries.empty())
+            glGenQueries(1, &state.query);
+        else
+        {
+            state.query = freeQueries.back();
+            freeQueries.pop_back();
+        }
+
+        // the unit cube spans [-1, 1]
+        const BvhNode& node = bvh.node(nodeIndex);
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), (node.boundsMin + node.boundsMax) * 0.5f);
+        model = glm::scale(model, (node.boundsMax - node.boundsMin) * 0.5f * BOX_SCALE);
+        boxShader.setMat4("model", model);
+
+        glBeginQuery(target, state.query);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glEndQuery(target);
+        state.queryFrame = frame;
+        pending.push_back(nodeIndex);
+    }
+
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+// Hardware occlusion culling with coherent hierarchical culling (CHC) over the scene BVH
+// the bounding boxes of BVH nodes are drawn against the depth buffer of the finished frame inside occlusion queries.
+// results are read back one frame later (at the latest after MAX_QUERY_LATENCY frames), so the CPU never waits on
+// the GPU; nodes found invisible are skipped with their whole subtree until a later query sees them again.
+// https://www.cg.tuwien.ac.at/research/publications/2004/Bittner-2004-CHC/
+
+#include <GL/glew.h> // include glew before gl.h (from glfw3)
+
+#include <glm.hpp>
+
+#include <vector>
+
+#include "bvh.h"
+#include "frustum.h"
+#include "shader.h"
+
+class OcclusionCuller
+{
+public:
+    OcclusionCuller();
+    ~OcclusionCuller();
+
+    // fetches the finished query results and updates the visibility of the nodes of bvh, call once per frame before cull
+    void update(const Bvh& bvh);
+    // front to back traversal of bvh from eye: fills visible with the items of visible leaves inside the frustum
+    // and remembers the nodes that need a new query
+    void cull(const Bvh& bvh, const Frustum& frustum, const glm::vec3& eye, std::vector<unsigned int>& visible);
+    // draws the bounding boxes of the remembered nodes inside occlusion queries, call after the visible objects were drawn
+    // boxShader has to transform the bound cube mesh (36 vertices) with the uniforms model and lightSpace (depthShader)
+    void issueQueries(const Bvh& bvh, Shader& boxShader, const glm::mat4& viewProjection);
+
+    size_t pendingQueries() const { return pending.size(); }
+
+private:
+    struct NodeState
+    {
+        GLuint query; // 0 if no query is in flight
+        unsigned int queryFrame; // frame the last query was issued
+        bool visible;
+    };
+
+    void reset(const Bvh& bvh);
+    void setSubtreeVisible(const Bvh& bvh, unsigned int nodeIndex);
+
+    std::vector<NodeState> states; // one per bvh node
+    std::vector<unsigned int> pending; // nodes with a query in flight
+    std::vector<unsigned int> toQuery; // nodes selected by the last cull
+    std::vector<GLuint> freeQueries;
+    size_t itemCount; // bvh size the states belong to, the bvh is rebuilt when it changes
+    unsigned int frame;
+    GLenum target; // GL_ANY_SAMPLES_PASSED_CONSERVATIVE if available
+};
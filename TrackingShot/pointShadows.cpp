@@ -0,0 +1,191 @@
+#include <gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "pointShadows.h"
+
+// face sizes in texels, halved for every halving of the screen coverage
+const unsigned int MAX_FACE_SIZE = 512;
+const unsigned int MIN_FACE_SIZE = 64;
+// must match POINT_SHADOW_NEAR in pointShadowFaces.glsl
+const float POINT_SHADOW_NEAR = 0.1f;
+
+// view directions and up vectors of the cube faces (+x, -x, +y, -y, +z, -z), must match pointShadowFaces.glsl
+const glm::vec3 FACE_FORWARD[CUBE_FACES] = {
+    glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1)
+};
+const glm::vec3 FACE_UP[CUBE_FACES] = {
+    glm::vec3(0, 1, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0), glm::vec3(0, 1, 0)
+};
+
+PointShadowAtlas::PointShadowAtlas(unsigned int size, GLuint meshBuffer, GLsizei meshStride) : size(size)
+{
+    glGenTextures(1, &depthTexture);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    // hardware compare with bilinear filtering, the lighting shader keeps its taps inside the tiles
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    renderer = new LayeredDepthRenderer(meshBuffer, meshStride, new Shader("shaders/pointShadow.vs", nullptr));
+}
+
+PointShadowAtlas::~PointShadowAtlas()
+{
+    delete renderer;
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &depthTexture);
+}
+
+void PointShadowAtlas::allocate(const std::vector<Light*>& lights, const glm::vec3& eye, float fovy)
+{
+    // slots follow the order of the point lights, their rendered state stays with them as long as the lights do
+    unsigned int count = 0;
+    for (const Light* light : lights)
+    {
+        if (light->radius <= 0.0f || !light->castsShadow || count == MAX_POINT_LIGHTS)
+            continue;
+        Slot fresh = {};
+        fresh.light = light;
+        if (count == slots.size())
+            slots.push_back(fresh);
+        else if (slots[count].light != light)
+            slots[count] = fresh;
+        ++count;
+    }
+    slots.resize(count);
+
+    // projected radius relative to half the screen height, 1 when the camera is inside the light
+    float tanHalfFovy = std::tan(glm::radians(fovy) * 0.5f);
+    std::vector<unsigned int> order(count);
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        Slot& slot = slots[i];
+        float distance = glm::distance(slot.light->position, eye);
+        float coverage = (distance <= slot.light->radius) ? 1.0f : slot.light->radius / (distance * tanHalfFovy);
+        slot.faceSize = MAX_FACE_SIZE;
+        while (slot.faceSize > MIN_FACE_SIZE && slot.faceSize / 2 >= coverage * MAX_FACE_SIZE)
+            slot.faceSize /= 2;
+        order[i] = i;
+    }
+
+    // shelf packing from the largest blocks down, lights that do not fit are halved until they do or get no shadow
+    std::stable_sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) { return slots[a].faceSize > slots[b].faceSize; });
+    unsigned int shelfX = 0, shelfY = 0, shelfHeight = 0;
+    for (unsigned int i : order)
+    {
+        Slot& slot = slots[i];
+        while (slot.faceSize > 0)
+        {
+            unsigned int width = 3 * slot.faceSize, height = 2 * slot.faceSize;
+            if (shelfX + width > size)
+            {
+                shelfY += shelfHeight;
+                shelfX = 0;
+                shelfHeight = 0;
+            }
+            if (shelfX + width <= size && shelfY + height <= size)
+            {
+                slot.origin = glm::uvec2(shelfX, shelfY);
+                shelfX += width;
+                shelfHeight = std::max(shelfHeight, height);
+                break;
+            }
+            slot.faceSize = (slot.faceSize > MIN_FACE_SIZE) ? slot.faceSize / 2 : 0;
+        }
+    }
+}
+
+int PointShadowAtlas::slotOf(const Light* light) const
+{
+    for (unsigned int i = 0; i < slots.size(); ++i)
+    {
+        if (slots[i].light == light)
+            return (int)i;
+    }
+    return -1;
+}
+
+glm::mat4 PointShadowAtlas::faceViewProjection(unsigned int slot, unsigned int face) const
+{
+    const Light& light = *slots[slot].light;
+    glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, POINT_SHADOW_NEAR, light.radius);
+    return projection * glm::lookAt(light.position, light.position + FACE_FORWARD[face], FACE_UP[face]);
+}
+
+bool PointShadowAtlas::isStale(unsigned int slot, unsigned int staticVersion, bool dynamicInRange) const
+{
+    const Slot& cached = slots[slot];
+    if (cached.faceSize == 0)
+        return false;
+    return !cached.valid || cached.position != cached.light->position || cached.faceSizeRendered != cached.faceSize
+        || cached.originRendered != cached.origin || cached.staticVersion != staticVersion
+        || dynamicInRange || cached.dynamicInRange;
+}
+
+void PointShadowAtlas::beginUpdate(unsigned int slot, unsigned int staticVersion, bool dynamicInRange)
+{
+    Slot& cached = slots[slot];
+    cached.valid = true;
+    cached.position = cached.light->position;
+    cached.faceSizeRendered = cached.faceSize;
+    cached.originRendered = cached.origin;
+    cached.staticVersion = staticVersion;
+    cached.dynamicInRange = dynamicInRange;
+
+    // only the block of this light is cleared, the other lights keep their depth
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(cached.origin.x, cached.origin.y, 3 * cached.faceSize, 2 * cached.faceSize);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+}
+
+void PointShadowAtlas::draw(const std::vector<LayerInstance>& instances)
+{
+    if (instances.empty())
+        return;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    Shader& shader = renderer->program();
+    shader.use();
+    for (unsigned int i = 0; i < slots.size(); ++i)
+        shader.setVec4("pointLightPosition[" + std::to_string(i) + "]", glm::vec4(slots[i].light->position, slots[i].light->radius));
+    setUniforms(shader, true);
+    // the four sides of the face frustum, the atlas viewport only clips at the atlas border
+    for (int i = 0; i < 4; ++i)
+        glEnable(GL_CLIP_DISTANCE0 + i);
+    renderer->draw(instances);
+    for (int i = 0; i < 4; ++i)
+        glDisable(GL_CLIP_DISTANCE0 + i);
+}
+
+void PointShadowAtlas::invalidate()
+{
+    for (Slot& slot : slots)
+        slot.valid = false;
+}
+
+void PointShadowAtlas::setUniforms(const Shader& shader, bool shadows) const
+{
+    for (unsigned int i = 0; i < slots.size(); ++i)
+    {
+        const Slot& slot = slots[i];
+        // xy: atlas position of the face block, z: size of a face, both in texture coordinates; w: face size in texels
+        unsigned int faceSize = (shadows) ? slot.faceSize : 0;
+        shader.setVec4("pointShadowRect[" + std::to_string(i) + "]", glm::vec4(glm::vec2(slot.origin) / (float)size, (float)faceSize / size, (float)faceSize));
+    }
+}
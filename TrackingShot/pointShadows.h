@@ -0,0 +1,76 @@
+#pragma once
+
+// Omnidirectional shadows of point lights in a shadow atlas
+// every point light gets the six faces of a cube shadow as a 3x2 block of square tiles in one depth texture. the face
+// size follows the screen coverage of the light, so small or distant lights use little space. all stale lights are
+// drawn in one instanced pass: every (object, face) pair is an instance, the vertex shader projects it with the cube
+// face of its light and moves it into the face's tile, clip distances keep it inside.
+// lights that did not move (and had no dynamic caster in range) keep their depth from previous frames.
+
+#include <GL/glew.h> // include glew before gl.h (from glfw3)
+
+#include <glm.hpp>
+
+#include <vector>
+
+#include "layeredShadows.h"
+#include "light.h"
+#include "shader.h"
+
+// must match MAX_POINT_LIGHTS in pointShadowFaces.glsl
+const unsigned int MAX_POINT_LIGHTS = 16;
+const unsigned int CUBE_FACES = 6;
+
+class PointShadowAtlas
+{
+public:
+    // size x size depth atlas, meshBuffer holds the cube mesh (36 vertices) with positions at location 0
+    PointShadowAtlas(unsigned int size, GLuint meshBuffer, GLsizei meshStride);
+    ~PointShadowAtlas();
+
+    // picks the shadowed point lights (radius > 0, castsShadow) of lights, chooses their face size from the screen coverage seen from eye
+    // (vertical field of view in degrees) and packs them into the atlas
+    void allocate(const std::vector<Light*>& lights, const glm::vec3& eye, float fovy);
+    unsigned int lightCount() const { return (unsigned int)slots.size(); }
+    const Light& light(unsigned int slot) const { return *slots[slot].light; }
+    // slot of light, -1 if it has no shadow
+    int slotOf(const Light* light) const;
+    // view projection of a cube face of slot, for culling
+    glm::mat4 faceViewProjection(unsigned int slot, unsigned int face) const;
+
+    // true if the depth of slot has to be rendered again: the light moved or got another tile, the static scene
+    // changed (staticVersion) or a dynamic caster is or was in range
+    bool isStale(unsigned int slot, unsigned int staticVersion, bool dynamicInRange) const;
+    // binds the atlas and clears the block of slot, its instances have to be part of the next draw
+    void beginUpdate(unsigned int slot, unsigned int staticVersion, bool dynamicInRange);
+    // draws the instances (layer: slot * CUBE_FACES + face) into the bound atlas, viewport and polygon offset are set
+    // by the caller
+    void draw(const std::vector<LayerInstance>& instances);
+    void invalidate();
+
+    // pointShadowRect of the lighting shader, without shadows all point lights are lit unshadowed
+    void setUniforms(const Shader& shader, bool shadows) const;
+    GLuint Texture() const { return depthTexture; }
+    unsigned int Size() const { return size; }
+
+private:
+    struct Slot
+    {
+        const Light* light;
+        unsigned int faceSize; // 0 if the light did not fit into the atlas
+        glm::uvec2 origin; // texel position of the 3x2 face block
+        // state of the rendered depth
+        bool valid;
+        glm::vec3 position;
+        unsigned int faceSizeRendered;
+        glm::uvec2 originRendered;
+        unsigned int staticVersion;
+        bool dynamicInRange;
+    };
+
+    unsigned int size;
+    GLuint depthTexture;
+    GLuint fbo;
+    LayeredDepthRenderer* renderer;
+    std::vector<Slot> slots;
+};
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "atomicFile.h"
+#include "programCache.h"
+
+const char* PROGRAM_CACHE_DIRECTORY = "shaderCache";
+
+const char PROGRAM_FILE_MAGIC[4] = { 'T', 'S', 'P', 'B' };
+const uint32_t PROGRAM_FILE_VERSION = 2;
+
+// 64 bit FNV-1a, enough to tell programs apart and to notice damaged binaries, the driver validates the rest
+static uint64_t hashBytes(const char* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static uint64_t hashString(const std::string& text, uint64_t hash)
+{
+    return hashBytes(text.data(), text.size(), hash);
+}
+
+static std::string programPath(const std::string& key)
+{
+    return std::string(PROGRAM_CACHE_DIRECTORY) + "/" + key + ".bin";
+}
+
+bool ProgramCache::isSupported()
+{
+    if (!GLEW_ARB_get_program_binary)
+        return false;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+std::string ProgramCache::key(const std::vector<std::string>& stageSources)
+{
+    // the binary is only valid for the driver that produced it
+    uint64_t hash = 14695981039346656037ull;
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+    {
+        const GLubyte* value = glGetString(name);
+        hash = hashString((value) ? (const char*)value : "", hash);
+    }
+    // the length separates the stages, so moving text from one stage to the next changes the key
+    for (const std::string& source : stageSources)
+        hash = hashString(std::to_string(source.size()) + ":" + source, hash);
+
+    std::ostringstream text;
+    text << std::hex;
+    text.width(16);
+    text.fill('0');
+    text << hash;
+    return text.str();
+}
+
+bool ProgramCache::load(GLuint program, const std::string& key)
+{
+    std::ifstream in(programPath(key), std::ios::binary);
+    char magic[4];
+    uint32_t version, format, length;
+    uint64_t checksum;
+    if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + 4, PROGRAM_FILE_MAGIC))
+        return false;
+    if (!in.read((char*)&version, sizeof(version)) || version != PROGRAM_FILE_VERSION)
+        return false;
+    if (!in.read((char*)&format, sizeof(format)) || !in.read((char*)&length, sizeof(length)) || length == 0)
+        return false;
+    if (!in.read((char*)&checksum, sizeof(checksum)))
+        return false;
+    std::vector<char> binary(length);
+    if (!in.read(binary.data(), length) || hashBytes(binary.data(), length) != checksum)
+        return false;
+
+    glProgramBinary(program, format, binary.data(), length);
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    return success == GL_TRUE;
+}
+
+void ProgramCache::store(GLuint program, const std::string& key)
+{
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (success != GL_TRUE)
+        return;
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+#ifdef _WIN32
+    _mkdir(PROGRAM_CACHE_DIRECTORY);
+#else
+    mkdir(PROGRAM_CACHE_DIRECTORY, 0755);
+#endif
+    // another instance may be loading the same binary, it is replaced only once it is complete
+    std::string path = programPath(key);
+    std::string temporary = temporaryPath(path);
+    std::ofstream out(temporary, std::ios::binary);
+    uint32_t storedFormat = format, storedLength = length;
+    uint64_t checksum = hashBytes(binary.data(), length);
+    out.write(PROGRAM_FILE_MAGIC, sizeof(PROGRAM_FILE_MAGIC));
+    out.write((const char*)&PROGRAM_FILE_VERSION, sizeof(PROGRAM_FILE_VERSION));
+    out.write((const char*)&storedFormat, sizeof(storedFormat));
+    out.write((const char*)&storedLength, sizeof(storedLength));
+    out.write((const char*)&checksum, sizeof(checksum));
+    out.write(binary.data(), length);
+    out.close();
+    if (!out)
+        std::remove(temporary.c_str());
+    if (!out || !replaceFile(temporary, path))
+        std::cout << "could not write the program binary " << path << std::endl;
+}
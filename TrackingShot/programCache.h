@@ -0,0 +1,28 @@
+#pragma once
+
+// Program binary cache
+// linked programs are stored with glGetProgramBinary under a hash of their stage sources and the driver (vendor,
+// renderer and version string), the next launch loads them with glProgramBinary instead of compiling and linking.
+// a binary the driver rejects (e.g. after a driver update with the same version string) falls back to compiling.
+// needs GL 4.1 or ARB_get_program_binary, otherwise every program is compiled as before.
+
+#include <GL/glew.h> // include glew before gl.h (from glfw3)
+
+#include <string>
+#include <vector>
+
+// directory of the cached binaries, relative to the working directory like the shaders
+extern const char* PROGRAM_CACHE_DIRECTORY;
+
+class ProgramCache
+{
+public:
+    static bool isSupported();
+
+    // key of a program from the type and source of all its stages (and whatever else changes the binary)
+    static std::string key(const std::vector<std::string>& stageSources);
+    // loads the binary stored for key into program, false if there is none or the driver rejected it
+    static bool load(GLuint program, const std::string& key);
+    // stores the binary of the linked program under key
+    static void store(GLuint program, const std::string& key);
+};
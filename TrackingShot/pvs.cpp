@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <thread>
+
+#include "pvs.h"
+#include "spline.h"
+
+// spline samples per segment for the arc length table
+const int SEGMENT_SAMPLES = 32;
+// camera positions tested per bucket, spread evenly over its arc length from its start to its end
+const int BUCKET_SAMPLES = 16;
+// the box swept by a bucket's camera positions is grown by this, well beyond the near plane of the camera
+const float EYE_MARGIN = 0.25f;
+// eyes tested per bucket, the camera positions and the corners of their grown box
+const int EYE_COUNT = BUCKET_SAMPLES + 8;
+// target points per edge of a box face, the faces turned towards the eye are sampled on this grid
+const int FACE_SAMPLES = 5;
+// buckets on either side whose objects are added to every set, for the eyes between the samples near the bucket ends
+const int NEIGHBOUR_BUCKETS = 1;
+// alpha of the centripetal spline used for the camera in main.cpp
+const float SPLINE_ALPHA = 0.5f;
+
+const char PATH_FILE_MAGIC[4] = { 'T', 'S', 'P', 'F' };
+const uint32_t PATH_FILE_VERSION = 2;
+
+// position on segment (from waypoint segment to segment + 1) at spline parameter t, same as the camera in main.cpp
+static glm::vec3 pathPosition(CameraPath& path, size_t segment, float t)
+{
+    std::vector<CameraWaypoint>& pts = path.Positions();
+    size_t size = pts.size();
+    return catmullSpline(SPLINE_ALPHA, pts[(segment + size - 1) % size].position, pts[segment].position,
+        pts[(segment + 1) % size].position, pts[(segment + 2) % size].position, t);
+}
+
+// true if a ray from eye reaches the center of the object's box or a point of the grid on one of its faces turned
+// towards eye without hitting an occluder
+static bool visibleFrom(const Bvh& bvh, const Bvh& occluders, const glm::vec3& eye, unsigned int object, unsigned int occluderFlags)
+{
+    const Aabb& box = bvh.bounds(object);
+    if (eye.x >= box.boundsMin.x && eye.y >= box.boundsMin.y && eye.z >= box.boundsMin.z &&
+        eye.x <= box.boundsMax.x && eye.y <= box.boundsMax.y && eye.z <= box.boundsMax.z)
+        return true;
+
+    // slightly shrunk, the targets lie inside the object's box so its neighbours do not hide its faces
+    glm::vec3 center = (box.boundsMin + box.boundsMax) * 0.5f;
+    glm::vec3 half = (box.boundsMax - box.boundsMin) * 0.5f * 0.99f;
+    if (!occluders.occluded(eye, center, object, occluderFlags))
+        return true;
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        // the eye sees the face on its side of the box, neither face if it is within the box's slab of this axis
+        float side;
+        if (eye[axis] < box.boundsMin[axis])
+            side = -1.0f;
+        else if (eye[axis] > box.boundsMax[axis])
+            side = 1.0f;
+        else
+            continue;
+
+        int u = (axis + 1) % 3, v = (axis + 2) % 3;
+        for (int i = 0; i < FACE_SAMPLES; ++i)
+        {
+            for (int j = 0; j < FACE_SAMPLES; ++j)
+            {
+                glm::vec3 target = center;
+                target[axis] += side * half[axis];
+                target[u] += (2.0f * i / (FACE_SAMPLES - 1) - 1.0f) * half[u];
+                target[v] += (2.0f * j / (FACE_SAMPLES - 1) - 1.0f) * half[v];
+                if (!occluders.occluded(eye, target, object, occluderFlags))
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+PathPvs::PathPvs() : segmentCount(0), totalLength(0), bakedScene(0), bucketCount(0), objectCount(0), wordsPerBucket(0)
+{
+}
+
+// continues the 64 bit FNV-1a hash with size bytes of data
+static void hashBytes(uint64_t& hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+}
+
+uint64_t PathPvs::sceneHash(CameraPath& path, const std::vector<Aabb>& boxes)
+{
+    uint64_t hash = 14695981039346656037ull;
+    uint32_t counts[2] = { (uint32_t)path.PositionsSize(), (uint32_t)boxes.size() };
+    hashBytes(hash, counts, sizeof(counts));
+    for (const CameraWaypoint& pt : path.Positions())
+    {
+        float position[3] = { pt.position.x, pt.position.y, pt.position.z };
+        hashBytes(hash, position, sizeof(position));
+    }
+    for (const Aabb& box : boxes)
+    {
+        float bounds[6] = { box.boundsMin.x, box.boundsMin.y, box.boundsMin.z, box.boundsMax.x, box.boundsMax.y, box.boundsMax.z };
+        hashBytes(hash, bounds, sizeof(bounds));
+    }
+    return hash;
+}
+
+void PathPvs::measure(CameraPath& path)
+{
+    segmentCount = path.PositionsSize();
+    arcLength.assign(segmentCount * (SEGMENT_SAMPLES + 1), 0.0f);
+    float length = 0;
+    for (size_t segment = 0; segment < segmentCount; ++segment)
+    {
+        glm::vec3 last = pathPosition(path, segment, 0);
+        for (int s = 0; s <= SEGMENT_SAMPLES; ++s)
+        {
+            glm::vec3 p = pathPosition(path, segment, (float)s / SEGMENT_SAMPLES);
+            length += glm::distance(last, p);
+            arcLength[segment * (SEGMENT_SAMPLES + 1) + s] = length;
+            last = p;
+        }
+    }
+    totalLength = length;
+}
+
+unsigned int PathPvs::bucketAt(size_t segment, float t) const
+{
+    if (bucketCount == 0 || segmentCount == 0 || totalLength <= 0)
+        return 0;
+
+    // interpolate the arc length between the two neighbouring samples
+    segment %= segmentCount;
+    float f = glm::clamp(t, 0.0f, 1.0f) * SEGMENT_SAMPLES;
+    int s = std::min((int)f, SEGMENT_SAMPLES - 1);
+    const float* samples = &arcLength[segment * (SEGMENT_SAMPLES + 1)];
+    float length = samples[s] + (samples[s + 1] - samples[s]) * (f - s);
+    return std::min(bucketCount - 1, (unsigned int)(length / totalLength * bucketCount));
+}
+
+void PathPvs::bake(CameraPath& path, const Bvh& bvh, const Bvh& occluders, unsigned int buckets, unsigned int occluderFlags)
+{
+    measure(path);
+    bucketCount = buckets;
+    objectCount = (unsigned int)bvh.size();
+    wordsPerBucket = (objectCount + 63) / 64;
+    std::vector<Aabb> boxes(objectCount);
+    for (unsigned int object = 0; object < objectCount; ++object)
+        boxes[object] = bvh.bounds(object);
+    bakedScene = sceneHash(path, boxes);
+    bits.assign((size_t)bucketCount * wordsPerBucket, 0);
+    if (segmentCount == 0 || bucketCount == 0)
+        return;
+
+    // camera positions of every bucket including both of its ends, found by walking the arc length table
+    std::vector<glm::vec3> samplePositions((size_t)bucketCount * BUCKET_SAMPLES);
+    size_t segment = 0;
+    int s = 0;
+    for (unsigned int i = 0; i < samplePositions.size(); ++i)
+    {
+        float target = (i / BUCKET_SAMPLES + (float)(i % BUCKET_SAMPLES) / (BUCKET_SAMPLES - 1)) / bucketCount * totalLength;
+        while (arcLength[segment * (SEGMENT_SAMPLES + 1) + s] < target && !(segment == segmentCount - 1 && s == SEGMENT_SAMPLES))
+        {
+            if (++s > SEGMENT_SAMPLES)
+            {
+                s = 1;
+                ++segment;
+            }
+        }
+        samplePositions[i] = pathPosition(path, segment, (float)s / SEGMENT_SAMPLES);
+    }
+
+    // the sets must also hold for the positions between the samples, so the corners of the box swept by the
+    // bucket's positions are tested as well; more eyes can only add visible objects
+    std::vector<glm::vec3> eyes((size_t)bucketCount * EYE_COUNT);
+    for (unsigned int bucket = 0; bucket < bucketCount; ++bucket)
+    {
+        const glm::vec3* positions = &samplePositions[(size_t)bucket * BUCKET_SAMPLES];
+        glm::vec3* bucketEyes = &eyes[(size_t)bucket * EYE_COUNT];
+        glm::vec3 sweptMin = positions[0], sweptMax = positions[0];
+        for (int p = 0; p < BUCKET_SAMPLES; ++p)
+        {
+            sweptMin = glm::min(sweptMin, positions[p]);
+            sweptMax = glm::max(sweptMax, positions[p]);
+            bucketEyes[p] = positions[p];
+        }
+        sweptMin -= glm::vec3(EYE_MARGIN);
+        sweptMax += glm::vec3(EYE_MARGIN);
+        for (int c = 0; c < 8; ++c)
+            bucketEyes[BUCKET_SAMPLES + c] = glm::vec3((c & 1) ? sweptMax.x : sweptMin.x, (c & 2) ? sweptMax.y : sweptMin.y, (c & 4) ? sweptMax.z : sweptMin.z);
+    }
+
+    // an object is visible from a bucket if a ray from any of its eyes reaches a sample point of the object's box
+    // without hitting an occluder
+    std::atomic<unsigned int> nextBucket(0);
+    auto worker = [&]()
+    {
+        for (unsigned int bucket = nextBucket++; bucket < bucketCount; bucket = nextBucket++)
+        {
+            uint64_t* words = &bits[(size_t)bucket * wordsPerBucket];
+            for (unsigned int object = 0; object < objectCount; ++object)
+            {
+                bool visible = false;
+                for (int e = 0; e < EYE_COUNT && !visible; ++e)
+                    visible = visibleFrom(bvh, occluders, eyes[(size_t)bucket * EYE_COUNT + e], object, occluderFlags);
+                if (visible)
+                    words[object / 64] |= uint64_t(1) << (object % 64);
+            }
+        }
+    };
+
+    unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < threadCount; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& thread : threads)
+        thread.join();
+
+    // the path is closed, the first and the last bucket are neighbours
+    std::vector<uint64_t> sampled = bits;
+    for (unsigned int bucket = 0; bucket < bucketCount; ++bucket)
+    {
+        uint64_t* words = &bits[(size_t)bucket * wordsPerBucket];
+        for (int offset = -NEIGHBOUR_BUCKETS; offset <= NEIGHBOUR_BUCKETS; ++offset)
+        {
+            unsigned int neighbour = (unsigned int)(((int)bucket + offset) % (int)bucketCount + (int)bucketCount) % bucketCount;
+            const uint64_t* neighbourWords = &sampled[(size_t)neighbour * wordsPerBucket];
+            for (unsigned int word = 0; word < wordsPerBucket; ++word)
+                words[word] |= neighbourWords[word];
+        }
+    }
+}
+
+size_t PathPvs::visibleCount(unsigned int bucket) const
+{
+    size_t count = 0;
+    for (unsigned int object = 0; object < objectCount; ++object)
+        count += isVisible(bucket, object);
+    return count;
+}
+
+void PathPvs::write(std::ostream& out) const
+{
+    uint32_t header[3] = { bucketCount, objectCount, wordsPerBucket };
+    out.write((const char*)header, sizeof(header));
+    out.write((const char*)&bakedScene, sizeof(bakedScene));
+    out.write((const char*)bits.data(), bits.size() * sizeof(uint64_t));
+}
+
+bool PathPvs::read(std::istream& in)
+{
+    uint32_t header[3];
+    uint64_t scene;
+    if (!in.read((char*)header, sizeof(header)) || header[2] != ((uint64_t)header[1] + 63) / 64 || !in.read((char*)&scene, sizeof(scene)))
+        return false;
+    // the counts come from the file, the bitsets they describe have to fit in the rest of it
+    std::streampos start = in.tellg();
+    in.seekg(0, std::ios::end);
+    std::streampos end = in.tellg();
+    in.seekg(start);
+    if (start < 0 || end < start || (uint64_t)header[0] * header[2] * sizeof(uint64_t) > (uint64_t)(end - start))
+        return false;
+    bakedScene = scene;
+    bucketCount = header[0];
+    objectCount = header[1];
+    wordsPerBucket = header[2];
+    bits.resize((size_t)bucketCount * wordsPerBucket);
+    return (bool)in.read((char*)bits.data(), bits.size() * sizeof(uint64_t));
+}
+
+bool savePathFile(const char* filename, CameraPath& path, const PathPvs& pvs)
+{
+    std::ofstream out(filename, std::ios::binary);
+    if (!out)
+        return false;
+
+    out.write(PATH_FILE_MAGIC, sizeof(PATH_FILE_MAGIC));
+    out.write((const char*)&PATH_FILE_VERSION, sizeof(PATH_FILE_VERSION));
+    uint32_t waypointCount = (uint32_t)path.PositionsSize();
+    out.write((const char*)&waypointCount, sizeof(waypointCount));
+    for (const CameraWaypoint& pt : path.Positions())
+    {
+        float values[7] = { pt.position.x, pt.position.y, pt.position.z, pt.rotation.w, pt.rotation.x, pt.rotation.y, pt.rotation.z };
+        out.write((const char*)values, sizeof(values));
+    }
+    pvs.write(out);
+    return (bool)out;
+}
+
+bool loadPathFile(const char* filename, CameraPath& path, PathPvs& pvs)
+{
+    std::ifstream in(filename, std::ios::binary);
+    char magic[4];
+    uint32_t version, waypointCount;
+    if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + 4, PATH_FILE_MAGIC))
+        return false;
+    if (!in.read((char*)&version, sizeof(version)) || version != PATH_FILE_VERSION)
+        return false;
+    if (!in.read((char*)&waypointCount, sizeof(waypointCount)) || waypointCount == 0)
+        return false;
+
+    CameraPath loaded;
+    for (uint32_t i = 0; i < waypointCount; ++i)
+    {
+        float values[7];
+        if (!in.read((char*)values, sizeof(values)))
+            return false;
+        CameraWaypoint pt;
+        pt.position = glm::vec3(values[0], values[1], values[2]);
+        pt.rotation = glm::quat(values[3], values[4], values[5], values[6]);
+        loaded.AddPosition(pt);
+    }
+    if (!pvs.read(in))
+        return false;
+
+    path = loaded;
+    pvs.measure(path);
+    return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+// Path aware potentially visible sets
+// the camera only moves along the Catmull-Rom spline of the CameraPath, so the path is split into buckets of equal
+// arc length and an offline bake stores for every bucket which static objects can be seen from anywhere inside it.
+// at playback only the current bucket's objects are considered for rendering. the bake errs towards visible: objects
+// only hide others with the boxes inscribed in them, and every set also holds the objects of the neighbouring buckets.
+// visibility is still sampled with rays, an object only seen through a gap between the samples can be missed.
+
+#include <glm.hpp>
+#include <gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "cameraPath.h"
+#include "bvh.h"
+
+class PathPvs
+{
+public:
+    PathPvs();
+
+    // computes the arc length table of the path, needed before bake and bucketAt
+    void measure(CameraPath& path);
+    // computes the visible sets for bucketCount buckets, objects are the items of the bvh in their index order.
+    // occluders holds the same items shrunk to boxes inside the objects (innerBounds), every one of them with all
+    // occluderFlags set can hide others
+    void bake(CameraPath& path, const Bvh& bvh, const Bvh& occluders, unsigned int bucketCount, unsigned int occluderFlags);
+
+    // bucket of the camera on segment (waypoint index the camera drives away from) at spline parameter t
+    unsigned int bucketAt(size_t segment, float t) const;
+    bool isVisible(unsigned int bucket, unsigned int object) const
+    {
+        return (bits[bucket * wordsPerBucket + object / 64] >> (object % 64)) & 1;
+    }
+
+    // hash of the waypoint positions and the boxes of the objects, the sets only hold for the scene they were baked for
+    static uint64_t sceneHash(CameraPath& path, const std::vector<Aabb>& boxes);
+    // true if the sets were baked or loaded for the scene with this sceneHash
+    bool matches(uint64_t scene) const
+    {
+        return bucketCount > 0 && bakedScene == scene;
+    }
+    unsigned int BucketCount() const { return bucketCount; }
+    unsigned int ObjectCount() const { return objectCount; }
+    size_t visibleCount(unsigned int bucket) const;
+
+    void write(std::ostream& out) const;
+    bool read(std::istream& in);
+
+private:
+    size_t segmentCount;
+    std::vector<float> arcLength; // arc length at each spline sample, SEGMENT_SAMPLES + 1 per segment
+    float totalLength;
+
+    uint64_t bakedScene; // sceneHash at bake time
+    unsigned int bucketCount;
+    unsigned int objectCount;
+    unsigned int wordsPerBucket;
+    std::vector<uint64_t> bits; // one bitset of objectCount bits per bucket
+};
+
+// path file: waypoints of the camera path followed by its baked visible sets
+bool savePathFile(const char* filename, CameraPath& path, const PathPvs& pvs);
+bool loadPathFile(const char* filename, CameraPath& path, PathPvs& pvs);
@@ -0,0 +1,74 @@
+#pragma once
+
+// GLM Mathematics
+#include <glm.hpp>
+
+// shading of a renderable, each one drawn with the cheapest permutation of the lighting shaders that covers it
+enum Material {
+    MATERIAL_LIT, // normal mapped, shadowed
+    MATERIAL_UNLIT, // only its color (light markers)
+    MATERIAL_COUNT
+};
+
+// a single instance of the cube mesh in the scene, collected once per frame before rendering
+struct Renderable
+{
+    glm::mat4 model;
+    glm::mat3 normalMatrix; // inverse transpose of model, once per object instead of per vertex
+    glm::vec4 color;
+    // world space axis aligned bounding box
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    bool castsShadow; // light markers are excluded from the depth map
+    bool isDynamic; // moves every frame (floating camera, light markers)
+    Material material;
+};
+
+// bits used to filter renderables in spatial queries
+enum Renderable_Flags {
+    RENDERABLE_CASTS_SHADOW = 1 << 0,
+    RENDERABLE_DYNAMIC = 1 << 1
+};
+
+inline unsigned int renderableFlags(const Renderable& renderable)
+{
+    return (renderable.castsShadow ? RENDERABLE_CASTS_SHADOW : 0) | (renderable.isDynamic ? RENDERABLE_DYNAMIC : 0);
+}
+
+// largest box with the proportions of the bounds of renderable that lies inside the transformed cube, equal to the
+// bounds for cubes that are not rotated. a face of the cube is at distance 1 along a row of the inverse model
+// (a column of normalMatrix), the box corner farthest along it must stay within that distance
+inline void innerBounds(const Renderable& renderable, glm::vec3& innerMin, glm::vec3& innerMax)
+{
+    glm::vec3 center = (renderable.boundsMin + renderable.boundsMax) * 0.5f;
+    glm::vec3 extent = (renderable.boundsMax - renderable.boundsMin) * 0.5f;
+    float reach = 0.0f;
+    for (int face = 0; face < 3; ++face)
+        reach = glm::max(reach, glm::dot(glm::abs(renderable.normalMatrix[face]), extent));
+    glm::vec3 inner = (reach > 0.0f) ? extent / reach : glm::vec3(0.0f);
+    innerMin = center - inner;
+    innerMax = center + inner;
+}
+
+// creates a renderable for the unit cube [-1, 1] in vertices transformed by model
+inline Renderable makeRenderable(const glm::mat4& model, const glm::vec4& color, bool castsShadow = true, bool isDynamic = false,
+    Material material = MATERIAL_LIT)
+{
+    // the extent of a transformed box is the absolute rotation/scale part applied to the local half size
+    glm::vec3 center(model[3]);
+    glm::vec3 extent(
+        glm::abs(model[0].x) + glm::abs(model[1].x) + glm::abs(model[2].x),
+        glm::abs(model[0].y) + glm::abs(model[1].y) + glm::abs(model[2].y),
+        glm::abs(model[0].z) + glm::abs(model[1].z) + glm::abs(model[2].z));
+
+    Renderable renderable;
+    renderable.model = model;
+    renderable.normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+    renderable.color = color;
+    renderable.boundsMin = center - extent;
+    renderable.boundsMax = center + extent;
+    renderable.castsShadow = castsShadow;
+    renderable.isDynamic = isDynamic;
+    renderable.material = material;
+    return renderable;
+}
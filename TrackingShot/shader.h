@@ -9,70 +9,65 @@
 #include <string>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
 #include <iostream>
+#include <utility>
+#include <vector>
+
+#include "programCache.h"
 
 class Shader
 {
 public:
     unsigned int ID;
     // constructor generates the shader on the fly
+    // without a fragment shader the program only writes depth (e.g. for shadow maps)
+    // defines ("NAME" or "NAME VALUE") are added to every stage, they select a permutation of the sources
+    // with parallel compilation (see parallelCompile) the build finishes in the background, see isReady
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+        const std::vector<std::string>& defines = std::vector<std::string>())
+        : vertexPath(vertexPath), fragmentPath(fragmentPath ? fragmentPath : ""), geometryPath(geometryPath ? geometryPath : ""),
+        defines(defines)
     {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
+        registry().push_back(this);
+        // 1. retrieve the vertex/fragment source code from filePath, with includes and defines
+        std::string vertexCode = readSource(vertexPath, defines, files);
         std::string fragmentCode;
         std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-            // if geometry shader path is present, also load a geometry shader
-            if (geometryPath != nullptr)
-            {
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
-        }
-        catch (std::ifstream::failure & e)
+        // if fragment shader path is present, also load a fragment shader
+        if (fragmentPath != nullptr)
+            fragmentCode = readSource(fragmentPath, defines, files);
+        // if geometry shader path is present, also load a geometry shader
+        if (geometryPath != nullptr)
+            geometryCode = readSource(geometryPath, defines, files);
+        // 2. use the binary of an earlier launch if the driver still accepts it
+        ID = glCreateProgram();
+        cacheable = ProgramCache::isSupported();
+        if (cacheable)
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+            cacheKey = ProgramCache::key({ vertexCode, fragmentCode, geometryCode });
+            if (ProgramCache::load(ID, cacheKey))
+                return;
         }
         const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
+        // 3. compile shaders
+        unsigned int vertex;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertex, 1, &vShaderCode, NULL);
         glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
+        stages.push_back(std::make_pair(vertex, std::string("VERTEX")));
         // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+        unsigned int fragment;
+        if (fragmentPath != nullptr)
+        {
+            const char* fShaderCode = fragmentCode.c_str();
+            fragment = glCreateShader(GL_FRAGMENT_SHADER);
+            glShaderSource(fragment, 1, &fShaderCode, NULL);
+            glCompileShader(fragment);
+            stages.push_back(std::make_pair(fragment, std::string("FRAGMENT")));
+        }
         // if geometry shader is given, compile geometry shader
         unsigned int geometry;
         if (geometryPath != nullptr)
@@ -81,26 +76,130 @@ public:
             geometry = glCreateShader(GL_GEOMETRY_SHADER);
             glShaderSource(geometry, 1, &gShaderCode, NULL);
             glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+            stages.push_back(std::make_pair(geometry, std::string("GEOMETRY")));
         }
         // shader Program
-        ID = glCreateProgram();
         glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
+        if (fragmentPath != nullptr)
+            glAttachShader(ID, fragment);
         if (geometryPath != nullptr)
             glAttachShader(ID, geometry);
+        if (cacheable)
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if (geometryPath != nullptr)
-            glDeleteShader(geometry);
+        // 4. errors are only checked once the driver is done, which blocks unless it compiles in parallel
+        pending = true;
+        if (!parallelCompile())
+            finish();
+    }
+    // constructor for a compute only program (needs OpenGL 4.3 or ARB_compute_shader)
+    // ------------------------------------------------------------------------
+    Shader(const char* computePath) : computePath(computePath)
+    {
+        registry().push_back(this);
+        std::string computeCode = readSource(computePath, defines, files);
+        ID = glCreateProgram();
+        cacheable = ProgramCache::isSupported();
+        if (cacheable)
+        {
+            cacheKey = ProgramCache::key({ "compute", computeCode });
+            if (ProgramCache::load(ID, cacheKey))
+                return;
+        }
+        const char* cShaderCode = computeCode.c_str();
+        unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute, 1, &cShaderCode, NULL);
+        glCompileShader(compute);
+        stages.push_back(std::make_pair(compute, std::string("COMPUTE")));
+        glAttachShader(ID, compute);
+        if (cacheable)
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(ID);
+        pending = true;
+        if (!parallelCompile())
+            finish();
+    }
+    // the program object stays with its owner, only the list of programs for reloading forgets it
+    // ------------------------------------------------------------------------
+    ~Shader()
+    {
+        delete reloaded;
+        registry().erase(std::remove(registry().begin(), registry().end(), this), registry().end());
+    }
+    // the program is referenced by its ID from the list of programs, it can not be copied
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+    // true if the driver compiles and links in the background (KHR/ARB_parallel_shader_compile)
+    // ------------------------------------------------------------------------
+    static bool parallelCompile()
+    {
+        return GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+    }
+    // polls the background build without blocking, the program can be used without waiting once this returns true
+    // ------------------------------------------------------------------------
+    bool isReady()
+    {
+        if (!pending)
+            return true;
+        GLint completed = GL_FALSE;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &completed);
+        if (completed)
+            finish();
+        return !pending;
+    }
+    // hot reloading: starts a background rebuild of every program that was built from file (a shader or one of
+    // its includes), the programs are replaced by swapReloaded
+    // ------------------------------------------------------------------------
+    static void reloadDependents(const std::string& file)
+    {
+        // reload() constructs the rebuild, which goes through the registry, so the matches are collected first
+        std::vector<Shader*> dependents;
+        for (Shader* shader : registry())
+        {
+            if (std::find(shader->files.begin(), shader->files.end(), file) != shader->files.end())
+                dependents.push_back(shader);
+        }
+        for (Shader* shader : dependents)
+            shader->reload();
+    }
+    // replaces the programs whose rebuild has finished, called at a frame boundary so that no frame mixes old and
+    // new programs of a pass; a rebuild that does not compile or link is dropped and the old program stays in use
+    // ------------------------------------------------------------------------
+    static void swapReloaded()
+    {
+        for (Shader* shader : registry())
+        {
+            Shader* rebuilt = shader->reloaded;
+            if (rebuilt == nullptr || !rebuilt->isReady())
+                continue;
+            GLint linked = GL_FALSE;
+            glGetProgramiv(rebuilt->ID, GL_LINK_STATUS, &linked);
+            if (linked)
+            {
+                if (shader->pending)
+                    shader->finish();
+                // the uniforms (sampler units, settings of the owner) are not set again by the owners
+                copyUniforms(shader->ID, rebuilt->ID);
+                glDeleteProgram(shader->ID);
+                shader->ID = rebuilt->ID;
+                shader->files = rebuilt->files;
+                std::cout << "Reloaded " << shader->name() << std::endl;
+            }
+            else
+            {
+                glDeleteProgram(rebuilt->ID);
+                std::cout << "Keeping the previous program of " << shader->name() << std::endl;
+            }
+            shader->reloaded = nullptr;
+            delete rebuilt;
+        }
     }
-    // activate the shader
+    // activate the shader, waits for the build if it is still running
     // ------------------------------------------------------------------------
     void use()
     {
+        if (pending)
+            finish();
         glUseProgram(ID);
     }
     // utility uniform functions
@@ -163,6 +262,187 @@ public:
     }
 
 private:
+    // stages of a program that is still being built, with their type for the error messages
+    std::vector<std::pair<unsigned int, std::string>> stages;
+    bool pending = false;
+    bool cacheable = false;
+    std::string cacheKey;
+    // what the program was built from, to build it again when one of its files changes
+    std::string vertexPath, fragmentPath, geometryPath, computePath;
+    std::vector<std::string> defines;
+    std::vector<std::string> files; // shaders and their includes
+    Shader* reloaded = nullptr; // rebuild in progress
+
+    // all constructed shaders, for reloading
+    static std::vector<Shader*>& registry()
+    {
+        static std::vector<Shader*> shaders;
+        return shaders;
+    }
+
+    // starts building the program again from its files, a rebuild that is still running is replaced
+    // ------------------------------------------------------------------------
+    void reload()
+    {
+        if (reloaded != nullptr)
+        {
+            glDeleteProgram(reloaded->ID);
+            delete reloaded;
+        }
+        if (!computePath.empty())
+            reloaded = new Shader(computePath.c_str());
+        else
+            reloaded = new Shader(vertexPath.c_str(), fragmentPath.empty() ? nullptr : fragmentPath.c_str(),
+                geometryPath.empty() ? nullptr : geometryPath.c_str(), defines);
+        // the rebuild itself is not reloaded
+        registry().pop_back();
+    }
+    std::string name() const
+    {
+        std::string name = computePath.empty() ? vertexPath + (fragmentPath.empty() ? "" : ", " + fragmentPath) : computePath;
+        for (const std::string& define : defines)
+            name += " " + define;
+        return name;
+    }
+
+    // copies the values of the uniforms both programs have from the program from to the program to
+    // ------------------------------------------------------------------------
+    static void copyUniforms(GLuint from, GLuint to)
+    {
+        GLint previous = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+        glUseProgram(to);
+        GLint count = 0;
+        glGetProgramiv(to, GL_ACTIVE_UNIFORMS, &count);
+        for (GLint i = 0; i < count; ++i)
+        {
+            GLchar uniformName[256];
+            GLint size = 0;
+            GLenum type = GL_NONE;
+            glGetActiveUniform(to, i, sizeof(uniformName), NULL, &size, &type, uniformName);
+            // arrays are reported by their first element, "name[0]"
+            std::string base(uniformName);
+            base = base.substr(0, base.find('['));
+            for (GLint element = 0; element < size; ++element)
+            {
+                std::string elementName = (size > 1) ? base + "[" + std::to_string(element) + "]" : std::string(uniformName);
+                GLint source = glGetUniformLocation(from, elementName.c_str());
+                GLint target = glGetUniformLocation(to, elementName.c_str());
+                // uniforms in blocks have no location
+                if (source >= 0 && target >= 0)
+                    copyUniform(from, source, target, type);
+            }
+        }
+        glUseProgram(previous);
+    }
+    static void copyUniform(GLuint from, GLint source, GLint target, GLenum type)
+    {
+        GLfloat f[16];
+        GLint i[4];
+        GLuint u[4];
+        switch (type)
+        {
+        case GL_FLOAT: glGetUniformfv(from, source, f); glUniform1fv(target, 1, f); break;
+        case GL_FLOAT_VEC2: glGetUniformfv(from, source, f); glUniform2fv(target, 1, f); break;
+        case GL_FLOAT_VEC3: glGetUniformfv(from, source, f); glUniform3fv(target, 1, f); break;
+        case GL_FLOAT_VEC4: glGetUniformfv(from, source, f); glUniform4fv(target, 1, f); break;
+        case GL_FLOAT_MAT2: glGetUniformfv(from, source, f); glUniformMatrix2fv(target, 1, GL_FALSE, f); break;
+        case GL_FLOAT_MAT3: glGetUniformfv(from, source, f); glUniformMatrix3fv(target, 1, GL_FALSE, f); break;
+        case GL_FLOAT_MAT4: glGetUniformfv(from, source, f); glUniformMatrix4fv(target, 1, GL_FALSE, f); break;
+        case GL_UNSIGNED_INT: glGetUniformuiv(from, source, u); glUniform1uiv(target, 1, u); break;
+        case GL_UNSIGNED_INT_VEC2: glGetUniformuiv(from, source, u); glUniform2uiv(target, 1, u); break;
+        case GL_UNSIGNED_INT_VEC3: glGetUniformuiv(from, source, u); glUniform3uiv(target, 1, u); break;
+        case GL_UNSIGNED_INT_VEC4: glGetUniformuiv(from, source, u); glUniform4uiv(target, 1, u); break;
+        case GL_INT_VEC2: case GL_BOOL_VEC2: glGetUniformiv(from, source, i); glUniform2iv(target, 1, i); break;
+        case GL_INT_VEC3: case GL_BOOL_VEC3: glGetUniformiv(from, source, i); glUniform3iv(target, 1, i); break;
+        case GL_INT_VEC4: case GL_BOOL_VEC4: glGetUniformiv(from, source, i); glUniform4iv(target, 1, i); break;
+        // int, bool and the samplers
+        default: glGetUniformiv(from, source, i); glUniform1iv(target, 1, i); break;
+        }
+    }
+
+    // reads a shader and adds a #define line for every entry of defines right after its #version line,
+    // the files read (the shader and its includes) are added to files
+    // ------------------------------------------------------------------------
+    static std::string readSource(const char* path, const std::vector<std::string>& defines, std::vector<std::string>& files)
+    {
+        std::vector<std::string> included;
+        std::string source = readFile(path, included);
+        files.insert(files.end(), included.begin(), included.end());
+        if (defines.empty())
+            return source;
+        size_t version = source.find("#version");
+        size_t lineEnd = (version == std::string::npos) ? std::string::npos : source.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return source;
+        ++lineEnd;
+        // #line keeps the line numbers of error messages those of the file
+        std::string header;
+        for (const std::string& define : defines)
+            header += "#define " + define + "\n";
+        header += "#line " + std::to_string(std::count(source.begin(), source.begin() + lineEnd, '\n') + 1) + "\n";
+        return source.substr(0, lineEnd) + header + source.substr(lineEnd);
+    }
+    // reads a shader file and replaces its #include "file" lines (relative to the including file) with the content
+    // of that file, every file is only included once
+    // ------------------------------------------------------------------------
+    static std::string readFile(const std::string& path, std::vector<std::string>& included)
+    {
+        std::ifstream shaderFile;
+        // ensure ifstream objects can throw exceptions:
+        shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        std::stringstream shaderStream;
+        try
+        {
+            shaderFile.open(path);
+            shaderStream << shaderFile.rdbuf();
+            shaderFile.close();
+        }
+        catch (std::ifstream::failure & e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << ": " << e.what() << std::endl;
+            return std::string();
+        }
+        included.push_back(path);
+
+        std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+        std::string code, line;
+        int lineNumber = 0;
+        while (std::getline(shaderStream, line))
+        {
+            ++lineNumber;
+            size_t start = line.find_first_not_of(" \t");
+            size_t open = line.find('"');
+            size_t close = (open == std::string::npos) ? open : line.find('"', open + 1);
+            if (start == std::string::npos || line.compare(start, 8, "#include") != 0 || close == std::string::npos)
+            {
+                code += line + "\n";
+                continue;
+            }
+            std::string includePath = directory + line.substr(open + 1, close - open - 1);
+            if (std::find(included.begin(), included.end(), includePath) == included.end())
+                code += "#line 1\n" + readFile(includePath, included);
+            code += "#line " + std::to_string(lineNumber + 1) + "\n";
+        }
+        return code;
+    }
+
+    // checks the compile and link status (blocking until they are known), stores the binary and frees the stages
+    // ------------------------------------------------------------------------
+    void finish()
+    {
+        for (const std::pair<unsigned int, std::string>& stage : stages)
+            checkCompileErrors(stage.first, stage.second);
+        checkCompileErrors(ID, "PROGRAM");
+        if (cacheable)
+            ProgramCache::store(ID, cacheKey);
+        // delete the shaders as they're linked into our program now and no longer necessery
+        for (const std::pair<unsigned int, std::string>& stage : stages)
+            glDeleteShader(stage.first);
+        stages.clear();
+        pending = false;
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -0,0 +1,50 @@
+#include <algorithm>
+
+#include "shaderVariants.h"
+
+ShaderVariants::ShaderVariants(const char* vertexPath, const char* fragmentPath, std::function<void(Shader&)> setup) :
+    vertexPath(vertexPath), fragmentPath(fragmentPath), setup(setup)
+{
+}
+
+ShaderVariants::~ShaderVariants()
+{
+    for (auto& entry : variants)
+    {
+        glDeleteProgram(entry.second.shader->ID);
+        delete entry.second.shader;
+    }
+}
+
+ShaderVariants::Variant& ShaderVariants::variant(const std::vector<std::string>& defines)
+{
+    // the order of the defines does not change the program
+    std::vector<std::string> key = defines;
+    std::sort(key.begin(), key.end());
+    auto found = variants.find(key);
+    if (found != variants.end())
+        return found->second;
+    Variant& created = variants[key];
+    created.shader = new Shader(vertexPath.c_str(), fragmentPath.c_str(), nullptr, key);
+    created.configured = false;
+    return created;
+}
+
+Shader& ShaderVariants::get(const std::vector<std::string>& defines)
+{
+    return *variant(defines).shader;
+}
+
+Shader* ShaderVariants::ready(const std::vector<std::string>& defines)
+{
+    Variant& found = variant(defines);
+    if (!found.shader->isReady())
+        return nullptr;
+    if (!found.configured)
+    {
+        if (setup)
+            setup(*found.shader);
+        found.configured = true;
+    }
+    return found.shader;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+// Shader permutations
+// one pair of shader files compiled with different sets of #define feature flags (e.g. SHADOWS, NORMAL_MAP,
+// PCF_KERNEL=N, UNLIT), so every material only pays for the features it uses. variants are built on first use and
+// kept for the rest of the run; across runs the program binary cache (programCache.h) keeps them.
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "shader.h"
+
+class ShaderVariants
+{
+public:
+    // setup is called once for every variant when it is ready, e.g. to assign its sampler units
+    ShaderVariants(const char* vertexPath, const char* fragmentPath, std::function<void(Shader&)> setup = nullptr);
+    ~ShaderVariants();
+
+    // the variant with defines, its build is started on the first call and may still be running
+    Shader& get(const std::vector<std::string>& defines);
+    // the variant with defines if it is built and set up, nullptr while it is still compiling
+    Shader* ready(const std::vector<std::string>& defines);
+
+private:
+    struct Variant
+    {
+        Shader* shader;
+        bool configured; // setup was called
+    };
+    Variant& variant(const std::vector<std::string>& defines);
+
+    std::string vertexPath, fragmentPath;
+    std::function<void(Shader&)> setup;
+    std::map<std::vector<std::string>, Variant> variants;
+};
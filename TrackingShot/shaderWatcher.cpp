@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "shaderWatcher.h"
+
+#ifdef _WIN32
+
+ShaderWatcher::ShaderWatcher(const std::string& directory) : directory(directory)
+{
+    notification = FindFirstChangeNotificationA(directory.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+    if (notification == INVALID_HANDLE_VALUE)
+        std::cout << "Shader hot reloading is not available for " << directory << std::endl;
+    scan(nullptr);
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+    if (notification != INVALID_HANDLE_VALUE)
+        FindCloseChangeNotification(notification);
+}
+
+void ShaderWatcher::scan(std::vector<std::string>* changed)
+{
+    WIN32_FIND_DATAA file;
+    HANDLE find = FindFirstFileA((directory + "/*").c_str(), &file);
+    if (find == INVALID_HANDLE_VALUE)
+        return;
+    do
+    {
+        if (file.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            continue;
+        uint64_t writeTime = (uint64_t)file.ftLastWriteTime.dwHighDateTime << 32 | file.ftLastWriteTime.dwLowDateTime;
+        auto known = writeTimes.find(file.cFileName);
+        bool modified = known == writeTimes.end() || known->second != writeTime;
+        writeTimes[file.cFileName] = writeTime;
+        if (modified && changed != nullptr)
+            changed->push_back(directory + "/" + file.cFileName);
+    } while (FindNextFileA(find, &file));
+    FindClose(find);
+}
+
+std::vector<std::string> ShaderWatcher::changedFiles()
+{
+    std::vector<std::string> changed;
+    if (notification == INVALID_HANDLE_VALUE || WaitForSingleObject(notification, 0) != WAIT_OBJECT_0)
+        return changed;
+    scan(&changed);
+    FindNextChangeNotification(notification);
+    return changed;
+}
+
+#else
+
+ShaderWatcher::ShaderWatcher(const std::string& directory) : directory(directory)
+{
+    descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    // written in place or saved to a temporary file and renamed
+    if (descriptor >= 0 && inotify_add_watch(descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        close(descriptor);
+        descriptor = -1;
+    }
+    if (descriptor < 0)
+        std::cout << "Shader hot reloading is not available for " << directory << std::endl;
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+    if (descriptor >= 0)
+        close(descriptor);
+}
+
+std::vector<std::string> ShaderWatcher::changedFiles()
+{
+    std::vector<std::string> changed;
+    if (descriptor < 0)
+        return changed;
+    alignas(inotify_event) char buffer[4096];
+    ssize_t length;
+    while ((length = read(descriptor, buffer, sizeof(buffer))) > 0)
+    {
+        for (char* event = buffer; event < buffer + length; )
+        {
+            const inotify_event* notification = reinterpret_cast<const inotify_event*>(event);
+            if (notification->len > 0)
+            {
+                std::string path = directory + "/" + notification->name;
+                if (std::find(changed.begin(), changed.end(), path) == changed.end())
+                    changed.push_back(path);
+            }
+            event += sizeof(inotify_event) + notification->len;
+        }
+    }
+    return changed;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+// Shader hot reloading
+// watches a directory for files that are written (or replaced, as most editors save) and reports their names once per
+// change, the main loop rebuilds the programs built from them (Shader::reloadDependents) and swaps them in between
+// frames (Shader::swapReloaded). inotify on Linux, a change notification and the write times of the files on Windows.
+// polling never blocks, a frame without changes costs one system call.
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+class ShaderWatcher
+{
+public:
+    explicit ShaderWatcher(const std::string& directory);
+    ~ShaderWatcher();
+
+    // paths (directory/name) of the files changed since the last call, every file once
+    std::vector<std::string> changedFiles();
+
+private:
+    std::string directory;
+#ifdef _WIN32
+    // the notification only says that something changed, the write times tell which files
+    void scan(std::vector<std::string>* changed);
+
+    // windows.h stays in the .cpp, its min / max macros break std::min / std::max in the files including this one
+    void* notification; // HANDLE
+    std::map<std::string, uint64_t> writeTimes; // FILETIME
+#else
+    int descriptor; // inotify instance, -1 if it is not available
+#endif
+};
@@ -0,0 +1,63 @@
+#version 430 core
+layout (local_size_x = 64) in;
+
+#include "object.glsl"
+
+layout (std430, binding = 0) readonly buffer Objects {
+    Object objects[];
+};
+
+// compacted indices of the visible objects, read by the indirect vertex shaders
+// the objects of range r start at r * instanceCapacity, the ranges are the materials or the static and dynamic casters
+layout (std430, binding = 1) writeonly buffer Instances {
+    uint instances[];
+};
+
+// DrawArraysIndirectCommand
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint first;
+    uint baseInstance;
+};
+
+// one command per range, instanceCount is reset to 0 before each dispatch
+layout (std430, binding = 2) buffer Commands {
+    DrawCommand commands[];
+};
+
+uniform vec4 planes[6];
+uniform int objectCount;
+uniform int instanceCapacity;
+uniform bool shadowPass;
+
+bool isVisible (vec3 boundsMin, vec3 boundsMax)
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        // corner farthest along the plane normal
+        vec3 p = mix(boundsMin, boundsMax, step(0.0, planes[i].xyz));
+        if (dot(planes[i].xyz, p) + planes[i].w < 0.0)
+            return false;
+    }
+    return true;
+}
+
+void main ()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= uint(objectCount))
+        return;
+
+    Object object = objects[i];
+    uint flags = uint(object.boundsMin.w);
+    if (shadowPass && (flags & OBJECT_CASTS_SHADOW) == 0u)
+        return;
+    if (!isVisible(object.boundsMin.xyz, object.boundsMax.xyz))
+        return;
+
+    // the shadow pass keeps the dynamic casters apart, the cached shadow map only draws those every frame
+    uint range = (shadowPass) ? (((flags & OBJECT_DYNAMIC) != 0u) ? 1u : 0u) : uint(object.boundsMax.w);
+    uint slot = atomicAdd(commands[range].instanceCount, 1u);
+    instances[range * uint(instanceCapacity) + slot] = i;
+}
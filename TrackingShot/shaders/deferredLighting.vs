@@ -0,0 +1,27 @@
+#version 330 core
+
+// lighting pass of the deferred path: one triangle covering the whole viewport, lightingShader.fs reads the surface
+// from the G-buffer, the interface block of lightingShader.vs is only declared to link with it
+out VS_OUT {
+    vec3 fragVert;
+    vec3 fragNormal;
+    vec2 texCoord;
+
+    float viewDepth;
+    vec4 baseColor;
+
+    mat3 TBN;
+} vs_out;
+
+void main()
+{
+    vs_out.fragVert = vec3(0.0);
+    vs_out.fragNormal = vec3(0.0);
+    vs_out.texCoord = vec2(0.0);
+    vs_out.viewDepth = 0.0;
+    vs_out.baseColor = vec4(0.0);
+    vs_out.TBN = mat3(1.0);
+
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
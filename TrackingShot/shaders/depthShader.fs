@@ -1,6 +0,0 @@
-#version 330 core
-
-void main()
-{
-    //fragmentdepth = gl_FragCoord.z; // not needed ->OpenGL does it anyway
-}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#version 430 core
+layout (location = 0) in vec3 aPos;
+
+#include "object.glsl"
+
+layout (std430, binding = 0) readonly buffer Objects {
+    Object objects[];
+};
+
+// visible object indices written by the culling compute shader
+layout (std430, binding = 1) readonly buffer Instances {
+    uint instances[];
+};
+// start of the range of the material being drawn
+uniform int firstInstance;
+
+uniform mat4 lightSpace;
+
+void main()
+{
+    mat4 model = objects[instances[firstInstance + gl_InstanceID]].model;
+    gl_Position = lightSpace * model * vec4(aPos, 1.0);
+}
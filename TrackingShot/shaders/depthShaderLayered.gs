@@ -0,0 +1,21 @@
+#version 330 core
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 3) out;
+
+flat in uint layer[];
+
+// must match CASCADE_COUNT in cascadedShadows.h
+const int CASCADE_COUNT = 3;
+uniform mat4 cascadeLightSpace[CASCADE_COUNT];
+
+// routes the triangle into the shadow layer of its instance
+void main()
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        gl_Layer = int(layer[0]);
+        gl_Position = cascadeLightSpace[layer[0]] * gl_in[i].gl_Position;
+        EmitVertex();
+    }
+    EndPrimitive();
+}
@@ -0,0 +1,18 @@
+#version 330 core
+// gl_Layer in the vertex shader, one of the two is required (checked by LayeredDepthRenderer)
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_layer : enable
+layout (location = 0) in vec3 aPos;
+// per instance: model matrix and shadow layer of one object
+layout (location = 5) in mat4 aModel;
+layout (location = 9) in uint aLayer;
+
+// must match CASCADE_COUNT in cascadedShadows.h
+const int CASCADE_COUNT = 3;
+uniform mat4 cascadeLightSpace[CASCADE_COUNT];
+
+void main()
+{
+    gl_Position = cascadeLightSpace[aLayer] * aModel * vec4(aPos, 1.0);
+    gl_Layer = int(aLayer);
+}
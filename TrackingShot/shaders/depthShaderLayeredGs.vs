@@ -0,0 +1,14 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// per instance: model matrix and shadow layer of one object
+layout (location = 5) in mat4 aModel;
+layout (location = 9) in uint aLayer;
+
+flat out uint layer;
+
+void main()
+{
+    // world space, depthShaderLayered.gs applies the light transform of the layer
+    gl_Position = aModel * vec4(aPos, 1.0);
+    layer = aLayer;
+}
@@ -0,0 +1,10 @@
+#version 330 core
+
+in vec4 baseColor;
+
+out vec4 FragColor;
+
+void main()
+{
+    FragColor = baseColor;
+}
@@ -0,0 +1,16 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+// flat colored stand-in for lightingShader.vs while the lit programs are still compiling
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec4 color;
+
+out vec4 baseColor;
+
+void main()
+{
+    baseColor = color;
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
@@ -0,0 +1,28 @@
+#version 430 core
+layout (location = 0) in vec3 aPos;
+
+#include "object.glsl"
+
+layout (std430, binding = 0) readonly buffer Objects {
+    Object objects[];
+};
+
+// visible object indices written by the culling compute shader
+layout (std430, binding = 1) readonly buffer Instances {
+    uint instances[];
+};
+// start of the range of the material being drawn
+uniform int firstInstance;
+
+// flat colored stand-in for lightingShaderIndirect.vs while the lit programs are still compiling
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec4 baseColor;
+
+void main()
+{
+    Object object = objects[instances[firstInstance + gl_InstanceID]];
+    baseColor = object.color;
+    gl_Position = projection * view * object.model * vec4(aPos, 1.0);
+}
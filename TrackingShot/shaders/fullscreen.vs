@@ -0,0 +1,11 @@
+#version 330 core
+
+out vec2 texCoord;
+
+// one triangle covering the whole viewport, generated without any vertex buffer
+void main()
+{
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    texCoord = position;
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,52 @@
+#version 330 core
+
+// geometry pass of the deferred path: the normal mapped surface into the G-buffer, lit by lightingShader.fs
+// permutations: UNLIT (albedo alpha 0, the lighting pass outputs the color as it is), NORMAL_MAP
+in VS_OUT {
+    vec3 fragVert;
+    vec3 fragNormal;
+    vec2 texCoord;
+
+    float viewDepth;
+    vec4 baseColor;
+
+    mat3 TBN; // world space tangent, bitangent and normal, for the normal map
+} fs_in;
+
+uniform sampler2D diffuseMap;
+uniform sampler2D normalMap;
+uniform float bumpiness;
+
+#include "normalMap.glsl"
+
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec2 gNormal;
+
+// octahedral encoding: the unit sphere projected onto the octahedron |x| + |y| + |z| = 1, lower half folded over
+vec2 encodeNormal (vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2((n.x >= 0.0) ? 1.0 : -1.0, (n.y >= 0.0) ? 1.0 : -1.0);
+    return n.xy;
+}
+
+void main ()
+{
+#ifdef UNLIT
+    gAlbedo = vec4(fs_in.baseColor.rgb, 0.0);
+    gNormal = vec2(0.0);
+    return;
+#endif
+
+#ifdef NORMAL_MAP
+    // obtain normal from normal map in range [0,1] and transform normal vector to range [-1,1], then to world space
+    vec3 normal = normalize(fs_in.TBN * normalize(sampleNormalMap(normalMap, fs_in.texCoord, bumpiness)));
+#else
+    vec3 normal = normalize(fs_in.fragNormal);
+#endif
+
+    // calculate final color of the pixel, based on baseColor mixed with texture; alpha 1 marks it as lit
+    gAlbedo = vec4(mix(texture(diffuseMap, fs_in.texCoord), fs_in.baseColor, 0.5).rgb, 1.0);
+    gNormal = encodeNormal(normal);
+}
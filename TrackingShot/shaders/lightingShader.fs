@@ -1,118 +1,366 @@
 #version 330 core
 
+// permutations (see shaderVariants.h), selected per material by the renderer:
+//   UNLIT         only the base color, no lighting, no shadow lookups
+//   NORMAL_MAP    normal from the normal map, the interpolated normal otherwise
+//   SHADOWS       cascade and point light shadows
+//   PCF_KERNEL=N  the PCF filters use (2N + 1)^2 taps
+//   DEFERRED      fullscreen lighting pass, the surface comes from the G-buffer
+#ifndef PCF_KERNEL
+#define PCF_KERNEL 1
+#endif
+
 // arguments from vertex shader
 in VS_OUT {
     vec3 fragVert;
     vec3 fragNormal;
     vec2 texCoord;
 
-    vec4 fragPosLightSpace;
+    float viewDepth; // distance along the view axis, selects the shadow cascade
     vec4 baseColor;
 
-    vec3 TangentLightPos;
-    vec3 TangentViewPos;
-    vec3 TangentFragPos;
+    mat3 TBN; // world space tangent, bitangent and normal, for the normal map
 } fs_in;
 
 // texture samplers
-uniform sampler2D shadowMap;
+uniform sampler2DArrayShadow shadowMap; // one layer per cascade, hardware depth compare with bilinear filtering
+uniform sampler2DArray momentsMap; // blurred (E)VSM moments per cascade, see shadowMoments.fs
 uniform sampler2D diffuseMap;
 uniform sampler2D normalMap;
+uniform sampler2DShadow pointShadowAtlas; // cube faces of the point lights, see pointShadows.h
 
 // light
 uniform struct Light {
    vec3 position;
    vec3 color;
 } light;
+uniform vec3 viewPos;
+
+// point lights, see clusteredLights.h: 2 texels per light (xyz: position, w: radius; rgb: color, a: shadow slot or -1)
+uniform samplerBuffer lightData;
+uniform usamplerBuffer clusterRanges; // per cluster: offset into clusterLights and light count
+uniform usamplerBuffer clusterLights; // light indices of all clusters
+uniform int lightCount;
+uniform bool clusteredLighting; // otherwise every fragment loops over all lights
+// must match clusteredLights.h
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 12;
+const int CLUSTER_Z = 24;
+uniform vec2 clusterScale; // clusters per pixel
+uniform vec2 clusterDepth; // slice = log(viewDepth) * x + y
+
+// deferred shading: the surface comes from the G-buffer (see gBuffer.h) instead of the vertex shader
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal; // octahedral encoded world space normal
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+uniform mat4 view;
+
+#include "pointShadowFaces.glsl"
+uniform vec4 pointShadowRect[MAX_POINT_LIGHTS]; // xy: face block in the atlas, z: face size (texture coordinates), w: face size in texels, 0 without shadow
+// depth bias of the cube shadows in texels of the face
+const float POINT_SHADOW_BIAS = 1.5;
 
 uniform float bumpiness;
+#include "normalMap.glsl"
+
+// cascaded shadow maps, must match CASCADE_COUNT in cascadedShadows.h
+const int CASCADE_COUNT = 3;
+uniform mat4 cascadeLightSpace[CASCADE_COUNT];
+uniform float cascadeSplits[CASCADE_COUNT]; // far distance of each cascade from the camera
+uniform float cascadeDepthRange[CASCADE_COUNT]; // world space depth of each light projection
+// constant bias in world units covering the PCF footprint, the slope part comes from glPolygonOffset in the depth pass
+const float SHADOW_BIAS = 0.05;
+
+// shadow filters, must match Shadow_Filter in main.cpp
+const int SHADOW_FILTER_HARDWARE = 0; // one bilinear compare
+const int SHADOW_FILTER_PCF = 1; // PCF_KERNEL^2 bilinear compares
+const int SHADOW_FILTER_ADAPTIVE = 2; // 4 compares, the full kernel only in penumbra regions
+const int SHADOW_FILTER_VSM = 3; // one fetch of the variance shadow map
+const int SHADOW_FILTER_EVSM = 4; // one fetch of the exponential variance shadow map
+uniform int shadowFilter;
+
+// must match shadowMoments.fs
+const float EVSM_POSITIVE = 40.0;
+const float EVSM_NEGATIVE = 5.0;
+const float VSM_MIN_VARIANCE = 0.00002;
+// part of the Chebyshev bound that is cut off, removes most of the light bleeding of overlapping occluders
+const float LIGHT_BLEEDING_REDUCTION = 0.3;
 
 out vec4 FragColor;
 
-float calcShadows (vec4 fragPosLightSpace)
+// 1 - bilinear hardware compare of the 2x2 texels around uv, the fraction of them in shadow
+float shadowTap (vec2 uv, int cascade, float depth)
+{
+    return 1.0 - texture(shadowMap, vec4(uv, cascade, depth));
+}
+
+// upper bound of the lit fraction at depth from the mean and mean square of the occluder depths
+float chebyshev (vec2 moments, float depth, float minVariance)
+{
+    // in front of the mean occluder -> fully lit
+    if (depth <= moments.x)
+        return 1.0;
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = depth - moments.x;
+    float pMax = variance / (variance + d * d);
+    return clamp((pMax - LIGHT_BLEEDING_REDUCTION) / (1.0 - LIGHT_BLEEDING_REDUCTION), 0.0, 1.0);
+}
+
+// shadow of a fragment at light space depth from one filtered fetch of the moments
+float momentShadow (vec2 uv, int cascade, float depth)
 {
+    vec4 moments = texture(momentsMap, vec3(uv, cascade));
+    if (shadowFilter == SHADOW_FILTER_VSM)
+        return 1.0 - chebyshev(moments.xy, depth, VSM_MIN_VARIANCE);
+
+    // the same warp as in shadowMoments.fs, the minimum variance scales with the derivative of the warp
+    float warped = 2.0 * depth - 1.0;
+    float positive = exp(EVSM_POSITIVE * warped);
+    float negative = -exp(-EVSM_NEGATIVE * warped);
+    float positiveLit = chebyshev(moments.xy, positive, VSM_MIN_VARIANCE * pow(EVSM_POSITIVE * positive, 2.0));
+    float negativeLit = chebyshev(moments.zw, negative, VSM_MIN_VARIANCE * pow(EVSM_NEGATIVE * negative, 2.0));
+    return 1.0 - min(positiveLit, negativeLit);
+}
+
+float calcShadows (vec3 fragPos, vec3 normal, float viewDepth)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    float cosTheta = dot(normal, lightDir);
+    // surfaces facing away from the light are in their own shadow, no fetch needed
+    if (cosTheta <= 0.0)
+        return 1.0;
+
+    // the first cascade that reaches past the fragment, nothing beyond the last one is shadowed
+    int cascade = 0;
+    while (cascade < CASCADE_COUNT && viewDepth > cascadeSplits[cascade])
+        ++cascade;
+    if (cascade == CASCADE_COUNT)
+        return 0.0;
+    vec4 fragPosLightSpace = cascadeLightSpace[cascade] * vec4(fragPos, 1.0);
+
     // perform perspective divide
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     // transform to [0,1] range
     projCoords = projCoords * 0.5 + 0.5;
-    // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
-    float closestDepth = texture(shadowMap, projCoords.xy).r;
-    // get depth of current fragment from light's perspective
-    float currentDepth = projCoords.z;
-    // calculate bias (based on depth map resolution and slope)
-    // to reduce shadow acne (ugly Moir-like pattern)
-    vec3 normal = normalize(fs_in.fragNormal);
-    //vec3 normal = normalize(texture(normalMap, fs_in.texCoord).rgb * 2.0 - 1.0);
-    vec3 lightDir = normalize(light.position - fs_in.fragVert);
-    float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005); // because bias is dependent on angle between light and surface
-    // check whether current frag pos is in shadow
-    float shadow = currentDepth - bias > closestDepth  ? 1.0 : 0.0;
-    // PCF
-    //float shadow = 0.0;
-
-    vec2 texelSize = 1.0/textureSize(shadowMap, 0);
-    for(int x = -1; x <= 1; ++x)
+    // keep the shadow at 0.0 when outside the light's frustum
+    if (any(lessThan(projCoords, vec3(0.0))) || any(greaterThan(projCoords, vec3(1.0))))
+        return 0.0;
+
+    // the moments are prefiltered, no bias and no kernel needed
+    if (shadowFilter >= SHADOW_FILTER_VSM)
+        return momentShadow(projCoords.xy, cascade, projCoords.z);
+
+    // the slope dependent part of the bias against shadow acne (ugly Moir-like pattern) is applied by glPolygonOffset
+    // in the depth pass, this only covers the filter footprint; world units converted to the depth range of the cascade
+    float bias = SHADOW_BIAS / cascadeDepthRange[cascade];
+    // depth of current fragment from light's perspective, compared against the map by the texture unit
+    float currentDepth = projCoords.z - bias;
+
+    if (shadowFilter == SHADOW_FILTER_HARDWARE)
+        return shadowTap(projCoords.xy, cascade, currentDepth);
+
+    // PCF: (2 * PCF_KERNEL + 1)^2 bilinear compares one texel apart (3x3 for a 4x4 texel footprint by default)
+    vec2 texelSize = 1.0 / textureSize(shadowMap, 0).xy;
+    const float taps = float((2 * PCF_KERNEL + 1) * (2 * PCF_KERNEL + 1));
+    float shadow = 0.0;
+    bool adaptive = shadowFilter == SHADOW_FILTER_ADAPTIVE;
+    if (adaptive)
+    {
+        // probe the four corners of the kernel first, if they agree the fragment is not in a penumbra
+        const float k = float(PCF_KERNEL);
+        shadow += shadowTap(projCoords.xy + vec2(-k, -k) * texelSize, cascade, currentDepth);
+        shadow += shadowTap(projCoords.xy + vec2( k, -k) * texelSize, cascade, currentDepth);
+        shadow += shadowTap(projCoords.xy + vec2(-k,  k) * texelSize, cascade, currentDepth);
+        shadow += shadowTap(projCoords.xy + vec2( k,  k) * texelSize, cascade, currentDepth);
+        if (shadow == 0.0 || shadow == 4.0)
+            return shadow * 0.25;
+    }
+
+    // full kernel, the adaptive filter in a penumbra only adds the taps it did not probe yet
+    for(int x = -PCF_KERNEL; x <= PCF_KERNEL; ++x)
     {
-        for(int y = -1; y <= 1; ++y)
+        for(int y = -PCF_KERNEL; y <= PCF_KERNEL; ++y)
         {
-            float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r;
-            shadow += currentDepth - bias > pcfDepth  ? 1.0 : 0.0;
+            if (adaptive && abs(x) == PCF_KERNEL && abs(y) == PCF_KERNEL)
+                continue;
+            shadow += shadowTap(projCoords.xy + vec2(x, y) * texelSize, cascade, currentDepth);
         }
     }
-    shadow /= 9.0;
+    return shadow / taps;
+}
+
+// 1 if the fragment at lightToFrag from the point light with shadow slot (and range far) is in its shadow
+float pointShadow (int slot, vec3 lightToFrag, float far)
+{
+    if (slot < 0)
+        return 0.0;
+    vec4 rect = pointShadowRect[slot];
+    if (rect.w == 0.0)
+        return 0.0;
 
-    // keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
-    if(projCoords.z > 1.0) shadow = 0.0;
+    // cube face along the major axis
+    vec3 a = abs(lightToFrag);
+    int face;
+    if (a.x >= a.y && a.x >= a.z)
+        face = (lightToFrag.x > 0.0) ? 0 : 1;
+    else if (a.y >= a.z)
+        face = (lightToFrag.y > 0.0) ? 2 : 3;
+    else
+        face = (lightToFrag.z > 0.0) ? 4 : 5;
 
-    return shadow;
+    // same projection as pointShadow.vs, the bias grows with the texel size at the fragment's distance
+    vec3 forward = FACE_FORWARD[face];
+    vec3 up = FACE_UP[face];
+    float distance = dot(forward, lightToFrag);
+    vec2 faceCoords = vec2(dot(cross(forward, up), lightToFrag), dot(up, lightToFrag)) / distance * 0.5 + 0.5;
+    distance -= POINT_SHADOW_BIAS * 2.0 * distance / rect.w;
+    float near = POINT_SHADOW_NEAR;
+    float depth = ((far + near) / (far - near) - 2.0 * far * near / ((far - near) * distance)) * 0.5 + 0.5;
+
+    // stay half a texel inside the tile, the bilinear taps must not reach the neighbouring face
+    faceCoords = clamp(faceCoords, 0.5 / rect.w, 1.0 - 0.5 / rect.w);
+    vec2 uv = rect.xy + (vec2(face % 3, face / 3) + faceCoords) * rect.z;
+    return 1.0 - texture(pointShadowAtlas, vec3(uv, depth));
 }
 
-void main ()
+// diffuse and specular light of point light i (without the surface color), ends smoothly at the light's radius
+vec3 calcPointLight (int i, vec3 fragPos, vec3 normal, vec3 viewDir)
 {
-    // calculate normal in world coordinates
-    //vec3 normal = normalize(fs_in.fragNormal);
-    // obtain normal from normal map in range [0,1] and transform normal vector to range [-1,1]
-    //vec3 normal = normalize(texture(normalMap, fs_in.texCoord).rgb * 2.0 - 1.0);
-    vec3 normal = normalize(texture(normalMap, fs_in.texCoord).rgb * 2.0 - bumpiness);
+    vec4 positionRadius = texelFetch(lightData, 2 * i);
+    vec3 toLight = positionRadius.xyz - fragPos;
+    float distance = length(toLight);
+    float radius = positionRadius.w;
+    if (distance >= radius)
+        return vec3(0.0);
+    vec3 lightDir = toLight / distance;
+    float diff = dot(normal, lightDir);
+    if (diff <= 0.0)
+        return vec3(0.0);
 
-    // calculate the location of this fragment (pixel) in world coordinates
-    //vec3 fragPosition = vec3(model * vec4(fragVert, 1));
-    // EDITED: not needed, just use input fragVert
+    float falloff = clamp(1.0 - pow(distance / radius, 4.0), 0.0, 1.0);
+    float attenuation = falloff * falloff / (1.0 + distance * distance);
+    float spec = pow(max(dot(normal, normalize(lightDir + viewDir)), 0.0), 32.0);
+    vec4 colorSlot = texelFetch(lightData, 2 * i + 1);
+    vec3 lighting = attenuation * (diff + spec) * colorSlot.rgb;
+#ifdef SHADOWS
+    lighting *= 1.0 - pointShadow(int(colorSlot.a), -toLight, radius);
+#endif
+    return lighting;
+}
 
-    // calculate final color of the pixel, based on baseColor mixed with texture
-    vec4 texColor = mix(texture(diffuseMap, fs_in.texCoord), fs_in.baseColor, 0.5);
+// octahedral normal encoding of gBuffer.fs
+vec3 decodeNormal (vec2 encoded)
+{
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2((n.x >= 0.0) ? -t : t, (n.y >= 0.0) ? -t : t);
+    return normalize(n);
+}
+
+void main ()
+{
+#ifdef UNLIT
+    // light markers: only their color, they are the light
+    FragColor = fs_in.baseColor;
+    return;
+#endif
+
+    // surface: world space position, normal mapped normal, normal for the shadow test, color and view depth
+    vec3 fragPos;
+    vec3 normal;
+    vec3 shadowNormal;
+    vec4 texColor;
+    float viewDepth;
+#ifdef DEFERRED
+    {
+        // fullscreen pass, everything comes from the G-buffer; pixels without geometry keep the clear color
+        ivec2 pixel = ivec2(gl_FragCoord.xy);
+        float depth = texelFetch(gDepth, pixel, 0).r;
+        if (depth == 1.0)
+            discard;
+        texColor = texelFetch(gAlbedo, pixel, 0);
+        // unlit materials are marked with albedo alpha 0
+        if (texColor.a == 0.0)
+        {
+            FragColor = vec4(texColor.rgb, 1.0);
+            return;
+        }
+        vec4 position = inverseViewProjection * vec4(gl_FragCoord.xy / vec2(textureSize(gDepth, 0)) * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+        fragPos = position.xyz / position.w;
+        normal = decodeNormal(texelFetch(gNormal, pixel, 0).xy);
+        shadowNormal = normal;
+        viewDepth = -(view * vec4(fragPos, 1.0)).z;
+    }
+#else
+    {
+        fragPos = fs_in.fragVert;
+        shadowNormal = normalize(fs_in.fragNormal);
+#ifdef NORMAL_MAP
+        // obtain normal from normal map in range [0,1] and transform normal vector to range [-1,1], then to world space
+        //vec3 normal = normalize(texture(normalMap, fs_in.texCoord).rgb * 2.0 - 1.0);
+        normal = normalize(fs_in.TBN * normalize(sampleNormalMap(normalMap, fs_in.texCoord, bumpiness)));
+#else
+        normal = shadowNormal;
+#endif
+        // calculate final color of the pixel, based on baseColor mixed with texture
+        texColor = mix(texture(diffuseMap, fs_in.texCoord), fs_in.baseColor, 0.5);
+        viewDepth = fs_in.viewDepth;
+    }
+#endif
 
     // calculate shadows
-    float shadow = calcShadows(fs_in.fragPosLightSpace);
+#ifdef SHADOWS
+    float shadow = calcShadows(fragPos, shadowNormal, viewDepth);
+#else
+    float shadow = 0.0;
+#endif
 
     /*
     // simple lighting
     // calculate the vector from this pixels surface to the light source
-    vec3 surfaceToLight = light.position - fs_in.fragVert;
+    vec3 surfaceToLight = light.position - fragPos;
     // calculate the cosine of the angle of incidence
     float brightness = clamp(dot(normal, surfaceToLight) / (length(surfaceToLight) * length(normal)), 0, 1);
     vec3 lighting = brightness * (1.0 - shadow) * light.color * texColor.rgb;
     */
 
-    // advanced lighting (ambient, diffuse and specular) -> need tangens
+    // advanced lighting (ambient, diffuse and specular) in world space
     // ambient
     vec3 ambient = 0.3 * texColor.rgb;
     //vec3 ambient = 0.3 * light.color;
 
     // diffuse
-    vec3 lightDir = normalize(fs_in.TangentLightPos - fs_in.TangentFragPos);
+    vec3 lightDir = normalize(light.position - fragPos);
     float diff = max(dot(lightDir, normal), 0.0);
     vec3 diffuse = diff * light.color * texColor.rgb;
 
     // specular
-    vec3 viewDir = normalize(fs_in.TangentViewPos - fs_in.TangentFragPos);
+    vec3 viewDir = normalize(viewPos - fragPos);
     vec3 reflectDir = reflect(-lightDir, normal);
     vec3 halfwayDir = normalize(lightDir + viewDir);
     float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
     vec3 specular = spec * light.color;
 
-    vec3 lighting = (ambient + (1.0 - shadow) * (diffuse + specular)) * texColor.rgb;
+    // point lights
+    vec3 pointLighting = vec3(0.0);
+    if (clusteredLighting)
+    {
+        // only the lights assigned to the cluster of this fragment
+        ivec3 cluster = ivec3(gl_FragCoord.xy * clusterScale, log(max(viewDepth, 1e-4)) * clusterDepth.x + clusterDepth.y);
+        cluster = clamp(cluster, ivec3(0), ivec3(CLUSTER_X, CLUSTER_Y, CLUSTER_Z) - 1);
+        uvec2 range = texelFetch(clusterRanges, (cluster.z * CLUSTER_Y + cluster.y) * CLUSTER_X + cluster.x).xy;
+        for (uint k = 0u; k < range.y; ++k)
+            pointLighting += calcPointLight(int(texelFetch(clusterLights, int(range.x + k)).r), fragPos, normal, viewDir);
+    }
+    else
+    {
+        for (int i = 0; i < lightCount; ++i)
+            pointLighting += calcPointLight(i, fragPos, normal, viewDir);
+    }
+
+    vec3 lighting = (ambient + (1.0 - shadow) * (diffuse + specular) + pointLighting) * texColor.rgb;
 
     // resulting fragment color
     FragColor = vec4(lighting, texColor.a); // 1.0
-}
\ No newline at end of file
+}
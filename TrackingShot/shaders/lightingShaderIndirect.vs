@@ -0,0 +1,21 @@
+#version 430 core
+#include "lightingVertex.glsl"
+#include "object.glsl"
+
+layout (std430, binding = 0) readonly buffer Objects {
+    Object objects[];
+};
+
+// visible object indices written by the culling compute shader
+layout (std430, binding = 1) readonly buffer Instances {
+    uint instances[];
+};
+// start of the range of the material being drawn
+uniform int firstInstance;
+
+void main ()
+{
+    // model, normal matrix and color come from the instance picked by the culling pass
+    Object object = objects[instances[firstInstance + gl_InstanceID]];
+    transformVertex(object.model, object.normalMatrix, object.color);
+}
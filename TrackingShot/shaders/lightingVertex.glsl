@@ -0,0 +1,48 @@
+// vertex stage of the lit objects, shared by lightingShader.vs (object from uniforms) and lightingShaderIndirect.vs
+// (object from the instance buffer of the GPU culling)
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+// normal, tangent and bitangent as one quaternion, see tangentFrames.h
+layout (location = 2) in vec4 aTangentFrame;
+
+// pass to fragment shader
+out VS_OUT {
+    vec3 fragVert;
+    vec3 fragNormal;
+    vec2 texCoord;
+
+    float viewDepth; // distance along the view axis, selects the shadow cascade
+    vec4 baseColor;
+
+    mat3 TBN; // world space tangent, bitangent and normal, for the normal map
+} vs_out;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// outputs of one vertex of the object, objectNormalMatrix is transpose(inverse(mat3(objectModel)))
+void transformVertex (mat4 objectModel, mat3 objectNormalMatrix, vec4 objectColor)
+{
+    // Pass some variables to the fragment shader
+    //vs_out.fragVert = aPos;
+    vs_out.fragVert = vec3(objectModel * vec4(aPos, 1.0));
+    vs_out.texCoord = aTexCoord;
+    
+    vs_out.viewDepth = -(view * vec4(vs_out.fragVert, 1.0)).z;
+    vs_out.baseColor = objectColor;
+
+    // tangent and normal are the first and last column of the rotation, tangents transform with the model matrix and
+    // stay perpendicular to the normal under non uniform scale, so no Gram-Schmidt is needed
+    vec4 q = normalize(aTangentFrame);
+    vec3 tangent = vec3(1.0 - 2.0 * (q.y * q.y + q.z * q.z), 2.0 * (q.x * q.y + q.w * q.z), 2.0 * (q.x * q.z - q.w * q.y));
+    vec3 normal = vec3(2.0 * (q.x * q.z + q.w * q.y), 2.0 * (q.y * q.z - q.w * q.x), 1.0 - 2.0 * (q.x * q.x + q.y * q.y));
+    vec3 n = normalize(objectNormalMatrix * normal);
+    vec3 t = normalize(mat3(objectModel) * tangent);
+    vec3 b = cross(n, t) * ((q.w < 0.0) ? -1.0 : 1.0); // negative w: mirrored uv mapping
+    vs_out.fragNormal = n;
+
+    vs_out.TBN = mat3(t, b, n);
+
+    // Apply all matrix transformations to vertices
+    gl_Position = projection * view * objectModel * vec4(aPos, 1.0f);
+}
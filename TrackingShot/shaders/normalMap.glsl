@@ -0,0 +1,9 @@
+// normal maps only store x and y (BC5 or RG8, see textureCompression.h), z is the positive root of the unit length.
+// returns the tangent space normal scaled like the former rgb * 2.0 - bumpiness on an RGB normal map
+vec3 sampleNormalMap(sampler2D normalMap, vec2 texCoord, float bumpiness)
+{
+    vec2 encoded = texture(normalMap, texCoord).rg;
+    vec2 xy = encoded * 2.0 - 1.0;
+    float z = sqrt(max(1.0 - dot(xy, xy), 0.0));
+    return vec3(encoded, z * 0.5 + 0.5) * 2.0 - bumpiness;
+}
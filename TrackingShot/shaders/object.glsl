@@ -0,0 +1,12 @@
+// one renderable in the object buffer of the GPU culling, must match GpuObject in gpuCulling.cpp
+struct Object {
+    mat4 model;
+    vec4 color;
+    vec4 boundsMin; // w: Renderable_Flags
+    vec4 boundsMax; // w: material
+    mat3 normalMatrix;
+};
+
+// Renderable_Flags in renderable.h
+const uint OBJECT_CASTS_SHADOW = 1u;
+const uint OBJECT_DYNAMIC = 2u;
@@ -0,0 +1,37 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// per instance: model matrix and cube face of one object, aTile = light * 6 + face
+layout (location = 5) in mat4 aModel;
+layout (location = 9) in uint aTile;
+
+#include "pointShadowFaces.glsl"
+
+uniform vec4 pointLightPosition[MAX_POINT_LIGHTS]; // xyz: position, w: radius (far plane)
+uniform vec4 pointShadowRect[MAX_POINT_LIGHTS]; // xy: face block in the atlas, z: face size (texture coordinates)
+
+void main()
+{
+    int light = int(aTile) / 6;
+    int face = int(aTile) % 6;
+
+    // view space of the face (same as lookAt), projected with a 90 degree perspective
+    vec3 forward = FACE_FORWARD[face];
+    vec3 up = FACE_UP[face];
+    vec3 p = vec3(aModel * vec4(aPos, 1.0)) - pointLightPosition[light].xyz;
+    vec3 v = vec3(dot(cross(forward, up), p), dot(up, p), -dot(forward, p));
+    float near = POINT_SHADOW_NEAR;
+    float far = pointLightPosition[light].w;
+    vec4 clip = vec4(v.xy, -(far + near) / (far - near) * v.z - 2.0 * far * near / (far - near), -v.z);
+
+    // the sides of the face frustum, the viewport covers the whole atlas
+    gl_ClipDistance[0] = clip.w - clip.x;
+    gl_ClipDistance[1] = clip.w + clip.x;
+    gl_ClipDistance[2] = clip.w - clip.y;
+    gl_ClipDistance[3] = clip.w + clip.y;
+
+    // scale and move the face into its tile of the 3x2 block
+    vec4 rect = pointShadowRect[light];
+    vec2 tileCenter = rect.xy + (vec2(face % 3, face / 3) + 0.5) * rect.z;
+    clip.xy = clip.xy * rect.z + (tileCenter * 2.0 - 1.0) * clip.w;
+    gl_Position = clip;
+}
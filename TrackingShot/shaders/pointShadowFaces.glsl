@@ -0,0 +1,5 @@
+// cube shadows of the point lights, must match pointShadows.h / pointShadows.cpp
+const int MAX_POINT_LIGHTS = 16;
+const float POINT_SHADOW_NEAR = 0.1;
+const vec3 FACE_FORWARD[6] = vec3[6](vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1));
+const vec3 FACE_UP[6] = vec3[6](vec3(0, 1, 0), vec3(0, 1, 0), vec3(0, 0, 1), vec3(0, 0, -1), vec3(0, 1, 0), vec3(0, 1, 0));
@@ -0,0 +1,43 @@
+#version 330 core
+
+in vec2 texCoord;
+
+out vec4 moments;
+
+uniform sampler2DArray source; // depth cascades in the first pass, moments in the second
+uniform int layer;
+uniform vec2 direction; // uv step between two taps of the blur
+uniform bool convertDepth; // source holds depth that still has to be turned into moments
+uniform bool exponential; // EVSM instead of VSM
+
+// must match lightingShader.fs
+const float EVSM_POSITIVE = 40.0;
+const float EVSM_NEGATIVE = 5.0;
+
+// 5 tap gaussian
+const float WEIGHTS[3] = float[](0.3877, 0.2448, 0.0614);
+
+vec4 toMoments (float depth)
+{
+    if (!exponential)
+        return vec4(depth, depth * depth, 0.0, 0.0);
+
+    // warp the depth to [-1, 1] first, the exponents are chosen for that range in 32 bit floats
+    float warped = 2.0 * depth - 1.0;
+    float positive = exp(EVSM_POSITIVE * warped);
+    float negative = -exp(-EVSM_NEGATIVE * warped);
+    return vec4(positive, positive * positive, negative, negative * negative);
+}
+
+vec4 fetch (vec2 uv)
+{
+    vec4 value = texture(source, vec3(uv, layer));
+    return (convertDepth) ? toMoments(value.r) : value;
+}
+
+void main()
+{
+    moments = fetch(texCoord) * WEIGHTS[0];
+    for (int i = 1; i < 3; ++i)
+        moments += (fetch(texCoord + direction * i) + fetch(texCoord - direction * i)) * WEIGHTS[i];
+}
@@ -0,0 +1,106 @@
+#include <gtc/matrix_transform.hpp>
+
+#include "shadowCache.h"
+
+// distance the light may move before the shadows follow it
+const float LIGHT_MOVE_THRESHOLD = 0.25f;
+
+ShadowCache::ShadowCache(unsigned int size, unsigned int layerCount) : size(size), margin(size / 2), layerSize(size + 2 * (size / 2)),
+    layers(layerCount), lightPosition(0.0f), lightTracked(false)
+{
+    // same format as the shadow map, so the depth can be blitted
+    glGenTextures(1, &depthTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, depthTexture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, layerSize, layerSize, layerCount, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    invalidate();
+}
+
+ShadowCache::~ShadowCache()
+{
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &depthTexture);
+}
+
+const glm::vec3& ShadowCache::trackLight(const glm::vec3& position)
+{
+    if (!lightTracked || glm::distance(position, lightPosition) > LIGHT_MOVE_THRESHOLD)
+    {
+        lightPosition = position;
+        lightTracked = true;
+    }
+    return lightPosition;
+}
+
+glm::vec2 ShadowCache::windowOffset(const Layer& cached, const ShadowCascade& cascade) const
+{
+    // both corners lie on the same texel grid, rounding only removes the float error
+    return glm::round((cascade.windowMin - cached.windowMin) / cascade.texel);
+}
+
+bool ShadowCache::isStale(unsigned int layer, const ShadowCascade& cascade, unsigned int staticVersion) const
+{
+    const Layer& cached = layers[layer];
+    if (!cached.valid || cached.staticVersion != staticVersion || cached.lightView != cascade.lightView
+        || cached.texel != cascade.texel || cached.depthNear != cascade.depthNear || cached.depthFar != cascade.depthFar)
+        return true;
+    glm::vec2 offset = windowOffset(cached, cascade);
+    float limit = (float)(layerSize - size);
+    return offset.x < 0 || offset.y < 0 || offset.x > limit || offset.y > limit;
+}
+
+glm::mat4 ShadowCache::beginUpdate(unsigned int layer, const ShadowCascade& cascade, unsigned int staticVersion)
+{
+    // the window in the middle of the layer, so the camera can move half a window in every direction
+    Layer& cached = layers[layer];
+    cached.valid = true;
+    cached.staticVersion = staticVersion;
+    cached.lightView = cascade.lightView;
+    cached.texel = cascade.texel;
+    cached.depthNear = cascade.depthNear;
+    cached.depthFar = cascade.depthFar;
+    cached.windowMin = cascade.windowMin - (float)margin * cascade.texel;
+    glm::vec2 windowMax = cached.windowMin + (float)layerSize * cascade.texel;
+    cached.lightSpace = glm::ortho(cached.windowMin.x, windowMax.x, cached.windowMin.y, windowMax.y, cascade.depthNear, cascade.depthFar)
+        * cascade.lightView;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, layer);
+    glViewport(0, 0, layerSize, layerSize);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    return cached.lightSpace;
+}
+
+void ShadowCache::bindLayered()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0);
+    glViewport(0, 0, layerSize, layerSize);
+}
+
+void ShadowCache::restore(unsigned int layer, const ShadowCascade& cascade, GLuint targetFBO)
+{
+    glm::vec2 offset = windowOffset(layers[layer], cascade);
+    GLint x = (GLint)offset.x, y = (GLint)offset.y;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, layer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFBO);
+    glBlitFramebuffer(x, y, x + size, y + size, 0, 0, size, size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
+    glViewport(0, 0, size, size);
+}
+
+void ShadowCache::invalidate()
+{
+    for (Layer& layer : layers)
+        layer.valid = false;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+// Cached shadow maps for static geometry
+// static casters are rendered into their own depth layers, one per cascade, that cover the cascade's window plus a
+// margin of half its size on every side. the cascades keep their light view and texel size while the camera moves and
+// only shift their windows by whole texels, so every frame the part under the window is copied into the shadow map
+// and only the dynamic casters are drawn on top. the static depth is rendered again when the window leaves the cached
+// area, its texel size or depth range changes (the light moved, the cascade grew), or the static scene changed.
+
+#include <GL/glew.h> // include glew before gl.h (from glfw3)
+
+#include <glm.hpp>
+
+#include <vector>
+
+#include "cascadedShadows.h"
+
+class ShadowCache
+{
+public:
+    // layers for cascades of size x size, same format as the cascaded shadow map
+    ShadowCache(unsigned int size, unsigned int layers);
+    ~ShadowCache();
+
+    // light position the shadows are rendered for: only follows position once it moved more than a threshold,
+    // so the light view (and the cached depth) stay the same while the light moves slowly
+    const glm::vec3& trackLight(const glm::vec3& position);
+    // true if the static depth of layer does not cover the window of cascade
+    // staticVersion identifies the state of the static scene (e.g. number of static objects)
+    bool isStale(unsigned int layer, const ShadowCascade& cascade, unsigned int staticVersion) const;
+    // binds and clears the static depth target of layer, sets the viewport to the layer size and returns the light
+    // transform of the area around the window of cascade the static casters have to be culled and rendered with
+    glm::mat4 beginUpdate(unsigned int layer, const ShadowCascade& cascade, unsigned int staticVersion);
+    // light transform the static depth of layer was rendered with
+    const glm::mat4& lightSpace(unsigned int layer) const { return layers[layer].lightSpace; }
+    // binds the static depth targets with all layers attached and sets the viewport to the layer size,
+    // for layered rendering after beginUpdate of the stale layers
+    void bindLayered();
+    // copies the static depth under the window of cascade into the depth attachment of targetFBO,
+    // leaves targetFBO bound with the viewport set to the cascade size
+    void restore(unsigned int layer, const ShadowCascade& cascade, GLuint targetFBO);
+    // forces an update of all layers on the next frame
+    void invalidate();
+
+private:
+    struct Layer
+    {
+        bool valid;
+        unsigned int staticVersion;
+        // texel grid and depth range the static depth was rendered with, windowMin is the corner of the whole layer
+        glm::mat4 lightView;
+        glm::vec2 windowMin;
+        glm::vec2 texel;
+        float depthNear, depthFar;
+        glm::mat4 lightSpace;
+    };
+
+    // offset of the window of cascade in the texels of layer
+    glm::vec2 windowOffset(const Layer& cached, const ShadowCascade& cascade) const;
+
+    GLuint fbo;
+    GLuint depthTexture;
+    unsigned int size; // of the cascades
+    unsigned int margin; // texels cached around the window on every side
+    unsigned int layerSize; // size + 2 * margin
+    std::vector<Layer> layers;
+    glm::vec3 lightPosition;
+    bool lightTracked;
+};
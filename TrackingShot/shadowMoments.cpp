@@ -0,0 +1,91 @@
+#include "shadowMoments.h"
+
+// texture unit used for the source of the conversion and blur passes
+const GLint SOURCE_UNIT = 4;
+
+static GLuint createMomentArray(unsigned int size, unsigned int layers, bool mipmapped)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA32F, size, size, layers, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, (mipmapped) ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (mipmapped)
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    return texture;
+}
+
+ShadowMoments::ShadowMoments(unsigned int shadowSize, unsigned int layers, unsigned int downsample) :
+    shader("shaders/fullscreen.vs", "shaders/shadowMoments.fs"), size(shadowSize / downsample), layers(layers)
+{
+    blurTexture = createMomentArray(size, layers, false);
+    momentsTexture = createMomentArray(size, layers, true);
+
+    glGenSamplers(1, &depthSampler);
+    glSamplerParameteri(depthSampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glSamplerParameteri(depthSampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glSamplerParameteri(depthSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(depthSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(depthSampler, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+
+    glGenVertexArrays(1, &vao);
+    glGenFramebuffers(1, &fbo);
+
+    shader.use();
+    shader.setInt("source", SOURCE_UNIT);
+}
+
+ShadowMoments::~ShadowMoments()
+{
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteSamplers(1, &depthSampler);
+    glDeleteTextures(1, &blurTexture);
+    glDeleteTextures(1, &momentsTexture);
+}
+
+void ShadowMoments::update(GLuint depthArray, bool exponential)
+{
+    GLint previousVao;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVao);
+    glBindVertexArray(vao);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, size, size);
+    glDisable(GL_DEPTH_TEST);
+
+    shader.use();
+    shader.setBool("exponential", exponential);
+    glActiveTexture(GL_TEXTURE0 + SOURCE_UNIT);
+    for (unsigned int layer = 0; layer < layers; ++layer)
+    {
+        shader.setInt("layer", layer);
+
+        // 1. depth -> moments, blurred horizontally (one output texel steps over downsample depth texels)
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, blurTexture, 0, layer);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+        glBindSampler(SOURCE_UNIT, depthSampler);
+        shader.setBool("convertDepth", true);
+        shader.setVec2("direction", 1.0f / size, 0.0f);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        // 2. vertical blur into the final moments
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, momentsTexture, 0, layer);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, blurTexture);
+        glBindSampler(SOURCE_UNIT, 0);
+        shader.setBool("convertDepth", false);
+        shader.setVec2("direction", 0.0f, 1.0f / size);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    // filtered fetches of wide areas use the smaller mip levels
+    glBindTexture(GL_TEXTURE_2D_ARRAY, momentsTexture);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glActiveTexture(GL_TEXTURE0);
+
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindVertexArray(previousVao);
+}
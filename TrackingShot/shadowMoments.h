@@ -0,0 +1,34 @@
+#pragma once
+
+// Variance / exponential variance shadow maps
+// the depth cascades are converted into moments (VSM: depth, depth^2; EVSM: both for a positive and a negative
+// exponential warp of the depth), blurred with a separable gaussian, optionally at a reduced resolution, and
+// mipmapped. one filtered fetch then replaces the PCF kernel in lightingShader.fs, whatever the filter width.
+// http://developer.download.nvidia.com/SDK/10/direct3d/Source/VarianceShadowMapping/Doc/VarianceShadowMapping.pdf
+
+#include <GL/glew.h> // include glew before gl.h (from glfw3)
+
+#include "shader.h"
+
+class ShadowMoments
+{
+public:
+    // moments of layers depth maps of shadowSize x shadowSize, stored with shadowSize / downsample texels
+    ShadowMoments(unsigned int shadowSize, unsigned int layers, unsigned int downsample);
+    ~ShadowMoments();
+
+    // converts every layer of depthArray (a depth texture array), blurs it and rebuilds the mip chain
+    void update(GLuint depthArray, bool exponential);
+
+    GLuint Texture() const { return momentsTexture; }
+
+private:
+    Shader shader;
+    GLuint fbo;
+    GLuint vao; // empty, the fullscreen triangle is generated from gl_VertexID
+    GLuint depthSampler; // reads the depth without the compare mode of the shadow sampler
+    GLuint blurTexture; // horizontally blurred moments
+    GLuint momentsTexture;
+    unsigned int size; // of the moment maps
+    unsigned int layers;
+};
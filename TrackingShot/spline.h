@@ -7,7 +7,7 @@
 #include <glm.hpp>
 
 // Calculate the t value for a CatmullRom spline
-float getKnot(float alpha, float t, glm::vec3 p0, glm::vec3 p1)
+inline float getKnot(float alpha, float t, glm::vec3 p0, glm::vec3 p1)
 {
     float a = pow((p1.x - p0.x), 2.0f) + pow((p1.y - p0.y), 2.0f) + pow((p1.z - p0.z), 2.0f);
     float b = pow(a, alpha * 0.5f);
@@ -17,7 +17,7 @@ float getKnot(float alpha, float t, glm::vec3 p0, glm::vec3 p1)
 
 // Given four points, calculate an interpolated point between p1 and p2 using a Catmul-Rom spline.
 // t specifies the position along the path, with t=0 being p1 and t=1 being p2.
-glm::vec3 catmullSpline(float alpha, glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, float t)
+inline glm::vec3 catmullSpline(float alpha, glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, float t)
 {
     float t0 = 0.0f;
     float t1 = getKnot(alpha, t0, p0, p1);
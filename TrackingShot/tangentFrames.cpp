@@ -0,0 +1,116 @@
+#include <gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <map>
+
+#include "tangentFrames.h"
+
+const size_t SOURCE_STRIDE = 8; // floats per source vertex: position, uv, normal
+// smallest |w| stored, keeps the sign of w (the handedness) alive through the snorm16 quantization
+const float QUATERNION_BIAS = 1.0f / 32767.0f;
+
+static GLshort packSnorm16(float value)
+{
+    return (GLshort)std::lround(glm::clamp(value, -1.0f, 1.0f) * 32767.0f);
+}
+
+static glm::vec3 sourceVec3(const GLfloat* vertex, size_t offset)
+{
+    return glm::vec3(vertex[offset], vertex[offset + 1], vertex[offset + 2]);
+}
+
+std::vector<MeshVertex> buildTangentFrames(const GLfloat* vertices, size_t vertexCount)
+{
+    // corners with equal position, uv and normal share one accumulated tangent and bitangent
+    std::map<std::array<GLfloat, SOURCE_STRIDE>, size_t> welded;
+    std::vector<size_t> cornerGroup(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        std::array<GLfloat, SOURCE_STRIDE> key;
+        std::copy(vertices + i * SOURCE_STRIDE, vertices + (i + 1) * SOURCE_STRIDE, key.begin());
+        cornerGroup[i] = welded.emplace(key, welded.size()).first->second;
+    }
+    std::vector<glm::vec3> tangents(welded.size(), glm::vec3(0.0f)), bitangents(welded.size(), glm::vec3(0.0f));
+
+    // per triangle: the directions of increasing u and v, weighted by the angle of each corner
+    for (size_t triangle = 0; triangle + 3 <= vertexCount; triangle += 3)
+    {
+        const GLfloat* corner[3] = { vertices + triangle * SOURCE_STRIDE, vertices + (triangle + 1) * SOURCE_STRIDE, vertices + (triangle + 2) * SOURCE_STRIDE };
+        glm::vec3 edge1 = sourceVec3(corner[1], 0) - sourceVec3(corner[0], 0);
+        glm::vec3 edge2 = sourceVec3(corner[2], 0) - sourceVec3(corner[0], 0);
+        glm::vec2 uv1 = glm::vec2(corner[1][3] - corner[0][3], corner[1][4] - corner[0][4]);
+        glm::vec2 uv2 = glm::vec2(corner[2][3] - corner[0][3], corner[2][4] - corner[0][4]);
+        float determinant = uv1.x * uv2.y - uv2.x * uv1.y;
+        if (std::abs(determinant) < 1e-8f)
+            continue; // degenerate uv mapping, the fallback below picks any tangent
+        glm::vec3 tangent = (edge1 * uv2.y - edge2 * uv1.y) / determinant;
+        glm::vec3 bitangent = (edge2 * uv1.x - edge1 * uv2.x) / determinant;
+
+        for (int c = 0; c < 3; ++c)
+        {
+            glm::vec3 position = sourceVec3(corner[c], 0);
+            glm::vec3 toNext = glm::normalize(sourceVec3(corner[(c + 1) % 3], 0) - position);
+            glm::vec3 toPrevious = glm::normalize(sourceVec3(corner[(c + 2) % 3], 0) - position);
+            float angle = std::acos(glm::clamp(glm::dot(toNext, toPrevious), -1.0f, 1.0f));
+            size_t group = cornerGroup[triangle + c];
+            tangents[group] += tangent * angle;
+            bitangents[group] += bitangent * angle;
+        }
+    }
+
+    std::vector<MeshVertex> result(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        const GLfloat* source = vertices + i * SOURCE_STRIDE;
+        glm::vec3 normal = glm::normalize(sourceVec3(source, 5));
+        size_t group = cornerGroup[i];
+
+        // Gram-Schmidt against the normal, any perpendicular direction if the uv mapping gave none
+        glm::vec3 tangent = tangents[group] - normal * glm::dot(normal, tangents[group]);
+        if (glm::dot(tangent, tangent) < 1e-12f)
+        {
+            glm::vec3 axis = (std::abs(normal.x) < 0.9f) ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            tangent = axis - normal * glm::dot(normal, axis);
+        }
+        tangent = glm::normalize(tangent);
+        glm::vec3 bitangent = glm::cross(normal, tangent);
+        bool mirrored = glm::dot(bitangent, bitangents[group]) < 0.0f;
+
+        // rotation of the right handed frame, w >= bias, then negated for a mirrored bitangent
+        glm::quat frame = glm::normalize(glm::quat_cast(glm::mat3(tangent, bitangent, normal)));
+        if (frame.w < 0.0f)
+            frame = -frame;
+        if (frame.w < QUATERNION_BIAS)
+        {
+            float scale = std::sqrt(1.0f - QUATERNION_BIAS * QUATERNION_BIAS);
+            frame = glm::quat(QUATERNION_BIAS, frame.x * scale, frame.y * scale, frame.z * scale);
+        }
+        if (mirrored)
+            frame = -frame;
+
+        MeshVertex& vertex = result[i];
+        vertex.position = sourceVec3(source, 0);
+        vertex.texCoord = glm::vec2(source[3], source[4]);
+        vertex.tangentFrame[0] = packSnorm16(frame.x);
+        vertex.tangentFrame[1] = packSnorm16(frame.y);
+        vertex.tangentFrame[2] = packSnorm16(frame.z);
+        vertex.tangentFrame[3] = packSnorm16(frame.w);
+    }
+    return result;
+}
+
+void setMeshVertexAttributes()
+{
+    // position attribute
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, position));
+    // texture coord attribute
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, texCoord));
+    // tangent frame attribute, snorm16 to [-1, 1]
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_SHORT, GL_TRUE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, tangentFrame));
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+// Precomputed tangent frames
+// tangents are generated once on the CPU from the uv layout of each triangle (accumulated over the corners that share
+// position, uv and normal, as MikkTSpace does) and stored together with the normal as one quaternion per vertex,
+// packed into four snorm16 values. the sign of the quaternion carries the handedness of the bitangent, so the vertex
+// shader rebuilds normal, tangent and bitangent from 8 bytes instead of guessing a tangent per vertex.
+// http://www.crytek.com/download/izfrey_siggraph2011.pdf (Frey, Spherical Skinning with Dual-Quaternions and QTangents)
+
+#include <GL/glew.h> // include glew before gl.h (from glfw3)
+
+#include <glm.hpp>
+
+#include <vector>
+
+// interleaved vertex of the lit meshes, attributes 0 - 2 of lightingShader.vs
+struct MeshVertex
+{
+    glm::vec3 position;
+    glm::vec2 texCoord;
+    GLshort tangentFrame[4]; // normalized quaternion x, y, z, w; w < 0 for a mirrored bitangent
+};
+
+// builds the vertices of a triangle list given as position, uv and normal (8 floats per vertex) with tangent frames
+std::vector<MeshVertex> buildTangentFrames(const GLfloat* vertices, size_t vertexCount);
+
+// binds the attributes of MeshVertex to the current vertex array, reading from the current GL_ARRAY_BUFFER
+void setMeshVertexAttributes();
@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include "atomicFile.h"
+#include "mappedFile.h"
+#include "textureCache.h"
+#include "textureCompression.h"
+#include "tgaDecoder.h"
+
+const char* TEXTURE_CACHE_DIRECTORY = "textureCache";
+
+const char TEXTURE_FILE_MAGIC[4] = { 'T', 'S', 'T', 'X' };
+const uint32_t TEXTURE_FILE_VERSION = 4;
+
+const GLenum UNCOMPRESSED_FORMATS[5] = { GL_NONE, GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+
+// followed by the source path, the size of every level, the version of every level file and the levels
+struct TextureFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    int64_t sourceTime;
+    uint64_t sourceSize;
+    uint32_t usage, width, height, components, internalFormat, levelCount, pathLength;
+};
+
+// modification time and size of the file a level was read from, zero if there is none
+struct LevelFileVersion
+{
+    int64_t time;
+    uint64_t size;
+};
+
+// 64 bit FNV-1a of the source path and the usage for the file name, both are stored to tell collisions apart
+static std::string cachePath(const std::string& source, Texture_Usage usage)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : source + ":" + std::to_string((int)usage))
+    {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    std::ostringstream text;
+    text << TEXTURE_CACHE_DIRECTORY << "/" << std::hex;
+    text.width(16);
+    text.fill('0');
+    text << hash;
+    text << ".tex";
+    return text.str();
+}
+
+// modification time and size of the source, false if it does not exist
+static bool sourceVersion(const std::string& source, int64_t& time, uint64_t& size)
+{
+    struct stat status;
+    if (stat(source.c_str(), &status) != 0)
+        return false;
+    time = (int64_t)status.st_mtime;
+    size = (uint64_t)status.st_size;
+    return true;
+}
+
+// versions of the level files of source that levels 1 and up may be read from (tgaLevelPath)
+static std::vector<LevelFileVersion> levelFileVersions(const std::string& source, const TextureLevels& levels)
+{
+    std::vector<LevelFileVersion> versions(levels.levelCount, LevelFileVersion{ 0, 0 });
+    if (!isTga(source))
+        return versions;
+    for (unsigned int level = 1; level < levels.levelCount; ++level)
+    {
+        if (!sourceVersion(tgaLevelPath(source, levels.LevelWidth(level)), versions[level].time, versions[level].size))
+            versions[level] = LevelFileVersion{ 0, 0 };
+    }
+    return versions;
+}
+
+// layout of a mapped cache file and the offset of its first level, false if it is not the current version of source
+static bool parse(const MappedFile& file, const std::string& source, Texture_Usage usage, TextureLevels& levels, size_t& dataOffset)
+{
+    int64_t time;
+    uint64_t size;
+    TextureFileHeader header;
+    if (!sourceVersion(source, time, size) || file.Size() < sizeof(header))
+        return false;
+    std::memcpy(&header, file.Data(), sizeof(header));
+    if (!std::equal(header.magic, header.magic + 4, TEXTURE_FILE_MAGIC) || header.version != TEXTURE_FILE_VERSION
+        || header.sourceTime != time || header.sourceSize != size || header.usage != (uint32_t)usage || header.pathLength != source.size()
+        || header.levelCount == 0 || header.levelCount > MAX_TEXTURE_LEVELS || header.components < 1 || header.components > 4)
+        return false;
+    size_t tableOffset = sizeof(header) + header.pathLength;
+    size_t versionOffset = tableOffset + header.levelCount * sizeof(uint64_t);
+    dataOffset = versionOffset + header.levelCount * sizeof(LevelFileVersion);
+    if (file.Size() < dataOffset || source.compare(0, source.size(), (const char*)file.Data() + sizeof(header), header.pathLength) != 0)
+        return false;
+
+    levels.width = (int)header.width;
+    levels.height = (int)header.height;
+    levels.components = (int)header.components;
+    levels.internalFormat = header.internalFormat;
+    levels.levelCount = header.levelCount;
+    size_t offset = 0;
+    for (unsigned int level = 0; level < levels.levelCount; ++level)
+    {
+        uint64_t levelSize;
+        std::memcpy(&levelSize, file.Data() + tableOffset + level * sizeof(uint64_t), sizeof(levelSize));
+        levels.offsets[level] = offset;
+        levels.sizes[level] = (size_t)levelSize;
+        offset += (size_t)levelSize;
+    }
+    // a level file that was edited, added or deleted since the bake changes the levels as well
+    std::vector<LevelFileVersion> versions = levelFileVersions(source, levels);
+    for (unsigned int level = 0; level < levels.levelCount; ++level)
+    {
+        LevelFileVersion stored;
+        std::memcpy(&stored, file.Data() + versionOffset + level * sizeof(LevelFileVersion), sizeof(stored));
+        if (stored.time != versions[level].time || stored.size != versions[level].size)
+            return false;
+    }
+    // a file that is still being written is too short
+    return file.Size() == dataOffset + levels.Size();
+}
+
+TextureLevels TextureCache::layout(int width, int height, int components, GLenum internalFormat)
+{
+    TextureLevels levels = {};
+    levels.width = width;
+    levels.height = height;
+    levels.components = components;
+    levels.internalFormat = (internalFormat == GL_NONE) ? UNCOMPRESSED_FORMATS[components] : internalFormat;
+    bool compressed = isCompressed(levels.internalFormat);
+    size_t offset = 0;
+    for (unsigned int level = 0; level < MAX_TEXTURE_LEVELS; ++level)
+    {
+        int levelWidth = levels.LevelWidth(level), levelHeight = levels.LevelHeight(level);
+        levels.offsets[level] = offset;
+        levels.sizes[level] = (compressed) ? compressedLevelSize(levelWidth, levelHeight, levels.internalFormat)
+            : (size_t)levelWidth * levelHeight * components;
+        offset += levels.sizes[level];
+        levels.levelCount = level + 1;
+        if (levelWidth == 1 && levelHeight == 1)
+            break;
+    }
+    return levels;
+}
+
+void TextureCache::buildMipmaps(const TextureLevels& levels, unsigned char* pixels)
+{
+    for (unsigned int level = 1; level < levels.levelCount; ++level)
+        buildMipmap(levels, pixels, level);
+}
+
+void TextureCache::buildMipmap(const TextureLevels& levels, unsigned char* pixels, unsigned int level)
+{
+    const int components = levels.components;
+    const unsigned char* source = pixels + levels.offsets[level - 1];
+    unsigned char* target = pixels + levels.offsets[level];
+    int sourceWidth = levels.LevelWidth(level - 1), sourceHeight = levels.LevelHeight(level - 1);
+    int width = levels.LevelWidth(level), height = levels.LevelHeight(level);
+    for (int y = 0; y < height; ++y)
+    {
+        // a side of 1 texel is not halved, its row or column is used twice
+        const unsigned char* row0 = source + (size_t)std::min(2 * y, sourceHeight - 1) * sourceWidth * components;
+        const unsigned char* row1 = source + (size_t)std::min(2 * y + 1, sourceHeight - 1) * sourceWidth * components;
+        for (int x = 0; x < width; ++x)
+        {
+            int x0 = std::min(2 * x, sourceWidth - 1) * components, x1 = std::min(2 * x + 1, sourceWidth - 1) * components;
+            for (int c = 0; c < components; ++c)
+                *target++ = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+        }
+    }
+}
+
+bool TextureCache::lookup(const std::string& source, Texture_Usage usage, TextureLevels& levels)
+{
+    MappedFile file(cachePath(source, usage));
+    size_t dataOffset;
+    return file.Data() != nullptr && parse(file, source, usage, levels, dataOffset);
+}
+
+bool TextureCache::read(const std::string& source, Texture_Usage usage, const TextureLevels& levels, unsigned char* pixels, unsigned int firstLevel)
+{
+    MappedFile file(cachePath(source, usage));
+    TextureLevels stored;
+    size_t dataOffset;
+    // the file may have been replaced since lookup
+    if (file.Data() == nullptr || !parse(file, source, usage, stored, dataOffset) || stored.Size() != levels.Size()
+        || stored.internalFormat != levels.internalFormat || stored.width != levels.width || stored.height != levels.height)
+        return false;
+    std::memcpy(pixels, file.Data() + dataOffset + levels.offsets[firstLevel], levels.Size() - levels.offsets[firstLevel]);
+    return true;
+}
+
+void TextureCache::store(const std::string& source, Texture_Usage usage, const TextureLevels& levels, const unsigned char* pixels)
+{
+    TextureFileHeader header = {};
+    if (!sourceVersion(source, header.sourceTime, header.sourceSize))
+        return;
+    std::copy(TEXTURE_FILE_MAGIC, TEXTURE_FILE_MAGIC + 4, header.magic);
+    header.version = TEXTURE_FILE_VERSION;
+    header.usage = (uint32_t)usage;
+    header.width = (uint32_t)levels.width;
+    header.height = (uint32_t)levels.height;
+    header.components = (uint32_t)levels.components;
+    header.internalFormat = levels.internalFormat;
+    header.levelCount = levels.levelCount;
+    header.pathLength = (uint32_t)source.size();
+
+#ifdef _WIN32
+    _mkdir(TEXTURE_CACHE_DIRECTORY);
+#else
+    mkdir(TEXTURE_CACHE_DIRECTORY, 0755);
+#endif
+    // not written in place, a reader mapping the file at the same time would see it shrink and fault on the lost pages
+    std::string path = cachePath(source, usage);
+    std::string temporary = temporaryPath(path);
+    std::ofstream out(temporary, std::ios::binary);
+    out.write((const char*)&header, sizeof(header));
+    out.write(source.data(), source.size());
+    for (unsigned int level = 0; level < levels.levelCount; ++level)
+    {
+        uint64_t levelSize = levels.sizes[level];
+        out.write((const char*)&levelSize, sizeof(levelSize));
+    }
+    std::vector<LevelFileVersion> versions = levelFileVersions(source, levels);
+    out.write((const char*)versions.data(), versions.size() * sizeof(LevelFileVersion));
+    out.write((const char*)pixels, levels.Size());
+    out.close();
+    if (!out)
+        std::remove(temporary.c_str());
+    if (!out || !replaceFile(temporary, path))
+        std::cout << "could not write the baked texture " << path << std::endl;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+// Baked texture cache
+// decoded images are stored with all their mip levels in textureCache/, keyed by the source path and its usage (an image
+// loaded as color and as normal map is baked twice) and validated by the modification time (and size) of the source
+// and of the mip level files of a TGA source (textureLoader.h), which may be added or removed as well.
+// the next launch maps the file and uploads the levels as they are, without decoding the image or generating mipmaps.
+// an edited source gets a new entry, deleting the directory is always safe.
+// compressed textures (textureCompression.h) are stored as their blocks, so the encoder also only runs once.
+
+#include <GL/glew.h> // include glew before gl.h (from glfw3)
+
+#include <cstddef>
+#include <string>
+
+#include "textureCompression.h"
+
+// directory of the baked textures, relative to the working directory like the textures
+extern const char* TEXTURE_CACHE_DIRECTORY;
+
+const unsigned int MAX_TEXTURE_LEVELS = 16;
+
+// an image with its mip chain, the levels packed one after another from the largest down
+struct TextureLevels
+{
+    int width, height; // of level 0
+    int components; // 1 - 4 8 bit channels, before compression
+    GLenum internalFormat; // an uncompressed format matching components or a block compressed one
+    unsigned int levelCount;
+    size_t offsets[MAX_TEXTURE_LEVELS];
+    size_t sizes[MAX_TEXTURE_LEVELS];
+
+    size_t Size() const { return (levelCount > 0) ? offsets[levelCount - 1] + sizes[levelCount - 1] : 0; }
+    int LevelWidth(unsigned int level) const { return (width >> level > 0) ? width >> level : 1; }
+    int LevelHeight(unsigned int level) const { return (height >> level > 0) ? height >> level : 1; }
+};
+
+class TextureCache
+{
+public:
+    // layout of the full mip chain of a width x height image, GL_NONE is the uncompressed format of components
+    static TextureLevels layout(int width, int height, int components, GLenum internalFormat = GL_NONE);
+    // fills levels 1 and up of uncompressed pixels from level 0 with a 2x2 box filter, like glGenerateMipmap
+    static void buildMipmaps(const TextureLevels& levels, unsigned char* pixels);
+    // fills only level (> 0) from the level above it
+    static void buildMipmap(const TextureLevels& levels, unsigned char* pixels, unsigned int level);
+
+    // layout of the baked levels of source, false if there are none for the current version of the source
+    static bool lookup(const std::string& source, Texture_Usage usage, TextureLevels& levels);
+    // copies the baked levels of source (as returned by lookup) from firstLevel down to pixels
+    static bool read(const std::string& source, Texture_Usage usage, const TextureLevels& levels, unsigned char* pixels, unsigned int firstLevel = 0);
+    // bakes the levels of source, the file is replaced only once it is complete so mapped readers are not disturbed
+    static void store(const std::string& source, Texture_Usage usage, const TextureLevels& levels, const unsigned char* pixels);
+};
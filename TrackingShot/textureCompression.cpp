@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "textureCompression.h"
+
+// blocks per thread before a level is split up, a 256 x 256 level is encoded in well under a millisecond
+const size_t PARALLEL_BLOCKS = 4096;
+
+int storedComponents(Texture_Usage usage, int components)
+{
+    return (usage == TEXTURE_NORMAL_MAP) ? 2 : components;
+}
+
+GLenum textureFormat(Texture_Usage usage, int components)
+{
+    if (usage == TEXTURE_NORMAL_MAP)
+        return (GLEW_VERSION_3_0 || GLEW_ARB_texture_compression_rgtc) ? GL_COMPRESSED_RG_RGTC2 : GL_RG8;
+    // BC1 alpha is only a cut out, colors with alpha stay uncompressed
+    const GLenum uncompressed[5] = { GL_NONE, GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+    if (components == 3 && GLEW_EXT_texture_compression_s3tc)
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    return uncompressed[components];
+}
+
+bool isCompressed(GLenum internalFormat)
+{
+    return internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || internalFormat == GL_COMPRESSED_RG_RGTC2;
+}
+
+size_t compressedLevelSize(int width, int height, GLenum internalFormat)
+{
+    size_t blockBytes = (internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) ? 8 : 16;
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+}
+
+// the 4x4 texels of block (x, y), edges of levels that are not a multiple of 4 repeat their last row and column
+static void fetchBlock(const unsigned char* pixels, int width, int height, int components, int blockX, int blockY, unsigned char texels[16][4])
+{
+    for (int y = 0; y < 4; ++y)
+    {
+        int row = std::min(blockY * 4 + y, height - 1);
+        for (int x = 0; x < 4; ++x)
+        {
+            const unsigned char* texel = pixels + ((size_t)row * width + std::min(blockX * 4 + x, width - 1)) * components;
+            for (int c = 0; c < components; ++c)
+                texels[y * 4 + x][c] = texel[c];
+        }
+    }
+}
+
+static uint16_t packColor(const int color[3])
+{
+    return (uint16_t)((((color[0] * 31 + 127) / 255) << 11) | (((color[1] * 63 + 127) / 255) << 5) | ((color[2] * 31 + 127) / 255));
+}
+
+static void unpackColor(uint16_t packed, int color[3])
+{
+    int r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// BC1 in four color mode: two RGB565 endpoints and 2 bit indices to them and the two colors in between
+static void encodeBC1(const unsigned char texels[16][4], unsigned char* block)
+{
+    int low[3] = { 255, 255, 255 }, high[3] = { 0, 0, 0 }, mean[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; ++i)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            low[c] = std::min(low[c], (int)texels[i][c]);
+            high[c] = std::max(high[c], (int)texels[i][c]);
+            mean[c] += texels[i][c];
+        }
+    }
+    // the box diagonal follows the colors: channels falling while the widest one rises have their ends swapped
+    int axis = 0;
+    for (int c = 1; c < 3; ++c)
+    {
+        if (high[c] - low[c] > high[axis] - low[axis])
+            axis = c;
+    }
+    for (int c = 0; c < 3; ++c)
+    {
+        if (c == axis)
+            continue;
+        int covariance = 0;
+        for (int i = 0; i < 16; ++i)
+            covariance += (texels[i][axis] * 16 - mean[axis]) * (texels[i][c] * 16 - mean[c]);
+        if (covariance < 0)
+            std::swap(low[c], high[c]);
+    }
+    // inset by 1/16 of the range, the outermost colors are rarely worth an endpoint of their own
+    for (int c = 0; c < 3; ++c)
+    {
+        int inset = (high[c] - low[c]) / 16;
+        high[c] -= inset;
+        low[c] += inset;
+    }
+
+    uint16_t color0 = packColor(high), color1 = packColor(low);
+    // color0 > color1 selects the four color mode
+    if (color0 < color1)
+        std::swap(color0, color1);
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        int end0[3], end1[3];
+        unpackColor(color0, end0);
+        unpackColor(color1, end1);
+        float direction[3] = { (float)(end1[0] - end0[0]), (float)(end1[1] - end0[1]), (float)(end1[2] - end0[2]) };
+        float scale = 3.0f / (direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+        // position along the line in thirds: color0, 2/3 color0 + 1/3 color1, 1/3 color0 + 2/3 color1, color1
+        const uint32_t order[4] = { 0, 2, 3, 1 };
+        for (int i = 0; i < 16; ++i)
+        {
+            float t = 0.0f;
+            for (int c = 0; c < 3; ++c)
+                t += (texels[i][c] - end0[c]) * direction[c];
+            int step = std::min(3, std::max(0, (int)(t * scale + 0.5f)));
+            indices |= order[step] << (2 * i);
+        }
+    }
+    block[0] = (unsigned char)(color0 & 0xFF);
+    block[1] = (unsigned char)(color0 >> 8);
+    block[2] = (unsigned char)(color1 & 0xFF);
+    block[3] = (unsigned char)(color1 >> 8);
+    for (int i = 0; i < 4; ++i)
+        block[4 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+// BC4 in eight value mode: the largest and smallest value and 3 bit indices to them and six values in between
+static void encodeBC4(const unsigned char texels[16][4], int channel, unsigned char* block)
+{
+    int low = 255, high = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        low = std::min(low, (int)texels[i][channel]);
+        high = std::max(high, (int)texels[i][channel]);
+    }
+    uint64_t indices = 0;
+    if (high > low)
+    {
+        int range = high - low;
+        for (int i = 0; i < 16; ++i)
+        {
+            // steps of 1/7 from high to low, the endpoints are indices 0 and 1, the values in between 2 - 7
+            int step = ((high - texels[i][channel]) * 7 + range / 2) / range;
+            uint64_t index = (step == 0) ? 0 : (step == 7) ? 1 : (uint64_t)(step + 1);
+            indices |= index << (3 * i);
+        }
+    }
+    block[0] = (unsigned char)high;
+    block[1] = (unsigned char)low;
+    for (int i = 0; i < 6; ++i)
+        block[2 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+static void compressRows(const unsigned char* pixels, int width, int height, int components, GLenum internalFormat,
+    unsigned char* blocks, int firstRow, int endRow)
+{
+    int blocksX = (width + 3) / 4;
+    size_t blockBytes = (internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) ? 8 : 16;
+    unsigned char texels[16][4] = {};
+    for (int blockY = firstRow; blockY < endRow; ++blockY)
+    {
+        for (int blockX = 0; blockX < blocksX; ++blockX)
+        {
+            unsigned char* block = blocks + ((size_t)blockY * blocksX + blockX) * blockBytes;
+            fetchBlock(pixels, width, height, components, blockX, blockY, texels);
+            if (internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+            {
+                encodeBC1(texels, block);
+            }
+            else
+            {
+                encodeBC4(texels, 0, block);
+                encodeBC4(texels, 1, block + 8);
+            }
+        }
+    }
+}
+
+void compressLevel(const unsigned char* pixels, int width, int height, int components, GLenum internalFormat, unsigned char* blocks,
+    unsigned int threadCount)
+{
+    int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    size_t threads = std::min<size_t>(threadCount, (size_t)blocksX * blocksY / PARALLEL_BLOCKS);
+    threads = std::min<size_t>(threads, blocksY);
+    if (threads <= 1)
+    {
+        compressRows(pixels, width, height, components, internalFormat, blocks, 0, blocksY);
+        return;
+    }
+
+    // every thread encodes a band of block rows, the calling thread the last one
+    int band = (int)((blocksY + threads - 1) / threads);
+    std::vector<std::thread> workers;
+    int firstRow = 0;
+    for (; firstRow + band < blocksY; firstRow += band)
+        workers.emplace_back(compressRows, pixels, width, height, components, internalFormat, blocks, firstRow, firstRow + band);
+    compressRows(pixels, width, height, components, internalFormat, blocks, firstRow, blocksY);
+    for (std::thread& worker : workers)
+        worker.join();
+}
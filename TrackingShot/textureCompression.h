@@ -0,0 +1,29 @@
+#pragma once
+
+// Block compressed textures
+// colors are stored as BC1 (DXT1, 4x4 RGB texels in 8 bytes, 6:1 against RGB8) and normal maps as BC5 (RGTC2, x and
+// y in two BC4 channels, 16 bytes per 4x4 texels); the shader reconstructs z (normalMap.glsl). the encoder fits the
+// endpoints to the bounding box of every block, which is fast enough to run at load time on the texture loader
+// threads, the result is baked by the texture cache. without driver support the textures stay uncompressed (RGB8 / RG8).
+
+#include <GL/glew.h> // include glew before gl.h (from glfw3)
+
+#include <cstddef>
+
+// how a texture is sampled, decides how it is stored
+enum Texture_Usage {
+    TEXTURE_COLOR,
+    TEXTURE_NORMAL_MAP // tangent space normals in rgb, only x and y are kept
+};
+
+// 8 bit channels stored for an image with components channels
+int storedComponents(Texture_Usage usage, int components);
+// internal format for the stored channels of usage, a compressed one if the driver supports it (GL thread only)
+GLenum textureFormat(Texture_Usage usage, int components);
+bool isCompressed(GLenum internalFormat);
+// bytes of a width x height level of a compressed format
+size_t compressedLevelSize(int width, int height, GLenum internalFormat);
+// encodes width x height pixels (components channels) into the blocks of internalFormat, BC1 from RGB, BC5 from RG.
+// large levels are split over at most threadCount threads, the calling one among them
+void compressLevel(const unsigned char* pixels, int width, int height, int components, GLenum internalFormat, unsigned char* blocks,
+    unsigned int threadCount = 1);
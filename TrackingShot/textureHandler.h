@@ -1,5 +0,0 @@
-#pragma once
-
-// utility function for loading a 2D texture from file
-// ---------------------------------------------------
-unsigned int loadTexture(char const* path);
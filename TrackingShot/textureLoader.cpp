@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "textureLoader.h"
+#include "tgaDecoder.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+// formats of the images by number of components
+const GLenum PIXEL_FORMATS[5] = { GL_NONE, GL_RED, GL_RG, GL_RGB, GL_RGBA };
+
+TextureLoader::TextureLoader(unsigned int threadCount) : stopping(false), idle(0)
+{
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int i = 0; i < threadCount; ++i)
+        threads.emplace_back(&TextureLoader::work, this);
+}
+
+TextureLoader::~TextureLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    for (std::thread& thread : threads)
+        thread.join();
+    // unfinished requests keep their placeholder
+    for (const std::unique_ptr<Job>& job : jobs)
+    {
+        if (job->pixelBuffer == 0)
+            continue;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job->pixelBuffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glDeleteBuffers(1, &job->pixelBuffer);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+GLuint TextureLoader::request(const char* path, const glm::vec4& placeholder, Texture_Usage usage, unsigned int firstLevel)
+{
+    // the binding of the active unit is restored, the caller decides where the texture is bound
+    GLint bound = 0;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    unsigned char texel[4];
+    for (int i = 0; i < 4; ++i)
+        texel[i] = (unsigned char)(glm::clamp(placeholder[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, bound);
+
+    // only the header is read here, the size of the pixel buffer must be known before the image is decoded.
+    // failed requests are reported by the next update like the others
+    std::unique_ptr<Job> job(new Job());
+    job->path = path;
+    job->texture = texture;
+    job->pixelBuffer = 0;
+    job->usage = usage;
+    job->cancelled = false;
+    job->state = JOB_FAILED;
+    // a baked texture is only used if it has the format the driver supports now
+    job->cached = TextureCache::lookup(path, usage, job->levels) && job->levels.internalFormat == textureFormat(usage, job->levels.components);
+    if (!job->cached)
+    {
+        int width, height, components;
+        if (!(isTga(path) && tgaInfo(path, width, height, components)) && !stbi_info(path, &width, &height, &components))
+        {
+            jobs.push_back(std::move(job));
+            return texture;
+        }
+        components = storedComponents(usage, components);
+        job->levels = TextureCache::layout(width, height, components, textureFormat(usage, components));
+    }
+    job->firstLevel = std::min(firstLevel, job->levels.levelCount - 1);
+    GLsizeiptr size = (GLsizeiptr)(job->levels.Size() - job->levels.offsets[job->firstLevel]);
+    glGenBuffers(1, &job->pixelBuffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job->pixelBuffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    job->mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (job->mapped == nullptr)
+    {
+        glDeleteBuffers(1, &job->pixelBuffer);
+        job->pixelBuffer = 0;
+        jobs.push_back(std::move(job));
+        return texture;
+    }
+    job->state = JOB_DECODING;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(job.get());
+    }
+    jobs.push_back(std::move(job));
+    wakeup.notify_one();
+    return texture;
+}
+
+void TextureLoader::cancel(GLuint texture)
+{
+    // the decoding thread may still write to the buffer, the job is dropped once it is done
+    for (const std::unique_ptr<Job>& job : jobs)
+    {
+        if (job->texture == texture)
+            job->cancelled = true;
+    }
+}
+
+unsigned int TextureLoader::update(size_t byteBudget, std::vector<LoadedTexture>* loaded)
+{
+    size_t uploaded = 0;
+    unsigned int finished = 0;
+    GLint bound = 0, alignment = 4;
+    bool saved = false; // the state changed by uploads, restored at the end
+    for (auto it = jobs.begin(); it != jobs.end() && (finished == 0 || uploaded < byteBudget); )
+    {
+        Job& job = **it;
+        int state = job.state.load();
+        if (state == JOB_DECODING)
+        {
+            ++it;
+            continue;
+        }
+        if (!saved)
+        {
+            saved = true;
+            glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+            glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        }
+        if (job.pixelBuffer != 0)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job.pixelBuffer);
+            // the buffer content is lost if the driver says so (e.g. after a mode switch)
+            if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+                state = JOB_FAILED;
+            glDeleteBuffers(1, &job.pixelBuffer);
+        }
+        if (job.cancelled)
+        {
+            it = jobs.erase(it);
+            continue;
+        }
+        if (state == JOB_DECODED)
+        {
+            // same texture object, the placeholder is replaced wherever it is bound
+            const TextureLevels& levels = job.levels;
+            unsigned int first = job.firstLevel, count = levels.levelCount - first;
+            GLenum format = PIXEL_FORMATS[levels.components];
+            glBindTexture(GL_TEXTURE_2D, job.texture);
+            // immutable storage for all levels at once if available, the driver does not have to guess the mip chain
+            bool storage = GLEW_ARB_texture_storage != 0;
+            if (storage)
+                glTexStorage2D(GL_TEXTURE_2D, count, levels.internalFormat, levels.LevelWidth(first), levels.LevelHeight(first));
+            bool compressed = isCompressed(levels.internalFormat);
+            for (unsigned int level = 0; level < count; ++level)
+            {
+                // level of the texture and level of the image
+                unsigned int source = first + level;
+                const void* offset = (const void*)(levels.offsets[source] - levels.offsets[first]);
+                GLsizei size = (GLsizei)levels.sizes[source];
+                GLsizei width = levels.LevelWidth(source), height = levels.LevelHeight(source);
+                if (compressed && storage)
+                    glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, levels.internalFormat, size, offset);
+                else if (compressed)
+                    glCompressedTexImage2D(GL_TEXTURE_2D, level, levels.internalFormat, width, height, 0, size, offset);
+                else if (storage)
+                    glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, format, GL_UNSIGNED_BYTE, offset);
+                else
+                    glTexImage2D(GL_TEXTURE_2D, level, levels.internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, offset);
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, count - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        }
+        else
+        {
+            std::cout << "Texture failed to load at path: " << job.path << std::endl;
+        }
+        LoadedTexture result = { job.texture, state != JOB_DECODED, job.levels, job.firstLevel };
+        uploaded += result.Size();
+        if (loaded != nullptr)
+            loaded->push_back(result);
+        ++finished;
+        it = jobs.erase(it);
+    }
+    if (saved)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, bound);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    }
+    return finished;
+}
+
+void TextureLoader::work()
+{
+    for (;;)
+    {
+        Job* job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ++idle;
+            wakeup.wait(lock, [this]() { return stopping || !queue.empty(); });
+            --idle;
+            if (stopping)
+                return;
+            job = queue.front();
+            queue.pop_front();
+        }
+        bool decoded = (job->cached) ? TextureCache::read(job->path, job->usage, job->levels, job->mapped, job->firstLevel) : decode(*job);
+        job->state.store(decoded ? JOB_DECODED : JOB_FAILED);
+    }
+}
+
+// the first components of every texel of source
+static void keepComponents(const unsigned char* source, int sourceComponents, unsigned char* target, int components, size_t texels)
+{
+    for (size_t i = 0; i < texels; ++i)
+    {
+        for (int c = 0; c < components; ++c)
+            target[i * components + c] = source[i * sourceComponents + c];
+    }
+}
+
+// decodes the width x height image at path as loadComponents channels and stores the first components of them in target
+static bool decodeImage(const std::string& path, int width, int height, int loadComponents, int components, unsigned char* target)
+{
+    size_t texels = (size_t)width * height;
+    int fileWidth, fileHeight, fileComponents;
+    if (isTga(path) && tgaInfo(path, fileWidth, fileHeight, fileComponents))
+    {
+        if (fileWidth != width || fileHeight != height)
+            return false;
+        // straight into the target unless channels are dropped
+        if (loadComponents == components)
+            return tgaLoad(path, target, components);
+        std::vector<unsigned char> data(texels * loadComponents);
+        if (!tgaLoad(path, data.data(), loadComponents))
+            return false;
+        keepComponents(data.data(), loadComponents, target, components, texels);
+        return true;
+    }
+    unsigned char* data = stbi_load(path.c_str(), &fileWidth, &fileHeight, &fileComponents, loadComponents);
+    bool decoded = data != nullptr && fileWidth == width && fileHeight == height;
+    if (decoded)
+        keepComponents(data, loadComponents, target, components, texels);
+    stbi_image_free(data);
+    return decoded;
+}
+
+bool TextureLoader::decode(Job& job)
+{
+    const TextureLevels& levels = job.levels;
+    // normal maps are decoded as RGB and reduced to x and y
+    int loadComponents = (job.usage == TEXTURE_NORMAL_MAP) ? 3 : levels.components;
+    // the mip levels are filtered in cached memory, the mapped buffer is only written once
+    TextureLevels plain = TextureCache::layout(levels.width, levels.height, levels.components);
+    std::vector<unsigned char> pixels(plain.Size());
+
+    if (!decodeImage(job.path, levels.width, levels.height, loadComponents, levels.components, pixels.data()))
+        return false;
+    // mip level files of a TGA image are decoded on this thread too, the other workers are busy with the other images;
+    // the missing levels are filtered after
+    std::vector<char> given(plain.levelCount, 0);
+    if (isTga(job.path))
+    {
+        for (unsigned int level = 1; level < plain.levelCount; ++level)
+        {
+            std::string levelPath = tgaLevelPath(job.path, plain.LevelWidth(level));
+            int width, height, components;
+            if (tgaInfo(levelPath, width, height, components))
+            {
+                given[level] = decodeImage(levelPath, plain.LevelWidth(level), plain.LevelHeight(level), loadComponents,
+                    levels.components, pixels.data() + plain.offsets[level]);
+            }
+        }
+    }
+    for (unsigned int level = 1; level < plain.levelCount; ++level)
+    {
+        if (!given[level])
+            TextureCache::buildMipmap(plain, pixels.data(), level);
+    }
+
+    if (isCompressed(levels.internalFormat))
+    {
+        std::vector<unsigned char> blocks(levels.Size());
+        for (unsigned int level = 0; level < levels.levelCount; ++level)
+        {
+            // extra threads only take the cores of idle workers, while the queue is busy every worker compresses its own image
+            compressLevel(pixels.data() + plain.offsets[level], plain.LevelWidth(level), plain.LevelHeight(level), levels.components,
+                levels.internalFormat, blocks.data() + levels.offsets[level], 1 + idle.load());
+        }
+        pixels.swap(blocks);
+    }
+    TextureCache::store(job.path, job.usage, levels, pixels.data());
+    std::memcpy(job.mapped, pixels.data() + levels.offsets[job.firstLevel], pixels.size() - levels.offsets[job.firstLevel]);
+    return true;
+}
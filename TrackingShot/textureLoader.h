@@ -0,0 +1,86 @@
+#pragma once
+
+// Asynchronous texture loading
+// request() returns a texture right away that holds a 1x1 placeholder color until the image is there. worker threads
+// decode the images (stb_image) into pixel buffer objects the GL thread mapped for them, update() then uploads the
+// finished ones from those buffers with a byte budget per frame. all requested images are decoded at the same time,
+// so waiting for the textures takes as long as the slowest one instead of the sum of all.
+// the mip levels are built on the decoding thread and baked into the texture cache (textureCache.h), images that are
+// baked already are only copied from their cache file.
+// TGA images go through the mapped, SIMD decoder of tgaDecoder.h; their mip levels may be given as files next to
+// them, named after the width of the level (wall.tga, wall256.tga, wall128.tga, ...), decoded by the same worker.
+
+#include <GL/glew.h> // include glew before gl.h (from glfw3)
+
+#include <glm.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "textureCache.h"
+#include "textureCompression.h"
+
+// a request finished by TextureLoader::update
+struct LoadedTexture
+{
+    GLuint texture;
+    bool failed; // the texture keeps its placeholder
+    TextureLevels levels; // of the whole image, the texture holds the levels from firstLevel down
+    unsigned int firstLevel;
+
+    // bytes of the texture on the GPU
+    size_t Size() const { return (failed) ? 0 : levels.Size() - levels.offsets[firstLevel]; }
+};
+
+class TextureLoader
+{
+public:
+    // threadCount 0 uses one decoding thread per core
+    explicit TextureLoader(unsigned int threadCount = 0);
+    ~TextureLoader();
+
+    // texture for the image at path, filled with placeholder (0 - 1) until update() uploads the image,
+    // usage selects the storage (and compression) of the image. with firstLevel > 0 the larger mip levels are
+    // left out, the texture starts at that level of the image
+    GLuint request(const char* path, const glm::vec4& placeholder, Texture_Usage usage = TEXTURE_COLOR, unsigned int firstLevel = 0);
+    // drops the request of texture, update() neither uploads nor reports it. the texture itself stays
+    void cancel(GLuint texture);
+    // uploads decoded images in request order until byteBudget is used (at least one image if any is decoded),
+    // returns the number of finished requests, which are added to loaded
+    unsigned int update(size_t byteBudget, std::vector<LoadedTexture>* loaded = nullptr);
+    // requests that are still decoding or waiting for their upload
+    size_t Pending() const { return jobs.size(); }
+
+private:
+    enum Job_State { JOB_DECODING, JOB_DECODED, JOB_FAILED };
+    struct Job
+    {
+        std::string path;
+        GLuint texture;
+        GLuint pixelBuffer;
+        unsigned char* mapped; // pixelBuffer, written by the decoding thread
+        Texture_Usage usage;
+        TextureLevels levels;
+        unsigned int firstLevel;
+        bool cached; // levels are read from the texture cache
+        bool cancelled;
+        std::atomic<int> state;
+    };
+    void work();
+    // decodes the image of job, builds its mip levels, compresses them if its format is compressed and bakes them
+    bool decode(Job& job);
+
+    std::vector<std::unique_ptr<Job>> jobs; // in request order, only used by the GL thread
+    std::deque<Job*> queue; // waiting for a decoding thread
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping;
+    std::atomic<unsigned int> idle; // workers waiting for a job, their cores are used for compressing
+    std::vector<std::thread> threads;
+};
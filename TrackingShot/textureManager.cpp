@@ -1,150 +1,198 @@
+#include <limits>
+#include <thread>
+
 #include "textureManager.h"
 
-#include <string>
-#include <iostream>
+// shown while a texture loads: grey and a flat normal
+static glm::vec4 placeholder(Texture_Usage usage)
+{
+    return (usage == TEXTURE_NORMAL_MAP) ? glm::vec4(0.5f, 0.5f, 1.0f, 1.0f) : glm::vec4(0.5f, 0.5f, 0.5f, 1.0f);
+}
 
-TextureManager* TextureManager::m_inst(0);
+// bytes of the levels of an image from firstLevel down
+static size_t levelsSize(const TextureLevels& levels, unsigned int firstLevel)
+{
+    return levels.Size() - levels.offsets[firstLevel];
+}
 
-TextureManager* TextureManager::Inst() {
-    if (!m_inst)
-        m_inst = new TextureManager();
+TextureHandle::TextureHandle(TextureManager* manager, TextureEntry* entry) : manager(manager), entry(entry)
+{
+    ++entry->references;
+}
 
-    return m_inst;
+TextureHandle::TextureHandle(const TextureHandle& other) : manager(other.manager), entry(other.entry)
+{
+    if (entry)
+        ++entry->references;
 }
 
-TextureManager::TextureManager() {
-#ifdef FREEIMAGE_LIB
-    FreeImage_Initialise(); // call this ONL-Y when linking with FreeImage as a static library
-#endif
+TextureHandle& TextureHandle::operator=(const TextureHandle& other)
+{
+    if (other.entry)
+        ++other.entry->references;
+    if (entry)
+        manager->release(entry);
+    manager = other.manager;
+    entry = other.entry;
+    return *this;
 }
 
-TextureManager::~TextureManager() {
-#ifdef FREEIMAGE_LIB
-    FreeImage_DeInitialise(); // call this ONLY when linking with FreeImage as a static library
-#endif
+TextureHandle::~TextureHandle()
+{
+    if (entry)
+        manager->release(entry);
+}
 
-    unloadAllTextures();
-    m_inst = 0;
+TextureManager::TextureManager(size_t budget) : budget(budget), memory(0), frame(0)
+{
 }
 
-void TextureManager::reportGLError(const char* msg) {
-    GLenum errCode;
-    const GLubyte* errString;
-    while ((errCode = glGetError()) != GL_NO_ERROR) {
-        errString = gluErrorString(errCode);
-        fprintf(stderr, "OpenGL Error: %s %s\n", msg, errString);
+TextureManager::~TextureManager()
+{
+    for (auto& found : entries)
+    {
+        TextureEntry& entry = *found.second;
+        if (entry.loading != 0 && entry.loading != entry.texture)
+            glDeleteTextures(1, &entry.loading);
+        glDeleteTextures(1, &entry.texture);
     }
-    return;
 }
 
-bool
-TextureManager::loadTexture(const char* filename, const unsigned int texID, GLint level, GLenum image_format, GLint internal_format, GLint border) {
-    tgaInfo* info = 0;
-    info = tgaLoad((char*)filename);
-    if (info->status != TGA_OK) {
-        fprintf(stderr, "error loading texture image: %s\n", filename);
-        return false;
+TextureHandle TextureManager::load(const std::string& path, Texture_Usage usage)
+{
+    std::unique_ptr<TextureEntry>& entry = entries[std::to_string(usage) + ":" + path];
+    if (!entry)
+    {
+        entry.reset(new TextureEntry());
+        entry->path = path;
+        entry->usage = usage;
+        entry->references = 0;
+        entry->levels = TextureLevels();
+        entry->firstLevel = 0;
+        entry->size = 0;
+        entry->lastUsed = frame;
+        request(*entry, 0);
+        // the first load fills the texture that is handed out
+        entry->texture = entry->loading;
     }
+    return TextureHandle(this, entry.get());
+}
 
-    //if this texture ID is in use, unload the current texture
-    if (m_texID.find(texID) != m_texID.end())
-        glDeleteTextures(1, &(m_texID[texID]));
-
-    GLuint gl_texID;
-    int mode = info->pixelDepth / 8; // will be 3 for rgb, 4 for rgba
-    GLint format = (mode == 4) ? GL_RGBA : GL_RGB;
-    GLsizei w = info->width;
-    GLsizei h = info->height;
-
-    glGenTextures(1, &gl_texID); //generate an OpenGL texture ID for this texture
-    m_texID[texID] = gl_texID; //store the texture ID mapping
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // should be default
-    glBindTexture(GL_TEXTURE_2D, gl_texID); //bind to the new texture ID
-
-    // additional params:
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    if (level > 0) {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
-        //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+void TextureManager::bind(const TextureHandle& texture, GLuint unit)
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, texture.Id());
+    glActiveTexture(GL_TEXTURE0);
+    if (texture.entry)
+        texture.entry->lastUsed = frame;
+}
+
+void TextureManager::update(size_t uploadBudget)
+{
+    std::vector<LoadedTexture> loaded;
+    loader.update(uploadBudget, &loaded);
+    apply(loaded);
+    balance();
+    ++frame;
+}
+
+void TextureManager::finish()
+{
+    while (loader.Pending() > 0)
+    {
+        std::vector<LoadedTexture> loaded;
+        if (loader.update(std::numeric_limits<size_t>::max(), &loaded) == 0)
+            std::this_thread::yield();
+        apply(loaded);
     }
-    else {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+}
+
+void TextureManager::release(TextureEntry* entry)
+{
+    if (--entry->references > 0)
+        return;
+    if (entry->loading != 0)
+    {
+        loader.cancel(entry->loading);
+        if (entry->loading != entry->texture)
+            glDeleteTextures(1, &entry->loading);
     }
+    glDeleteTextures(1, &entry->texture);
+    memory -= entry->size;
+    entries.erase(std::to_string(entry->usage) + ":" + entry->path);
+}
+
+void TextureManager::request(TextureEntry& entry, unsigned int firstLevel)
+{
+    entry.loading = loader.request(entry.path.c_str(), placeholder(entry.usage), entry.usage, firstLevel);
+    entry.loadingLevel = firstLevel;
+}
 
-    GLint clamp_mode = GL_REPEAT; // or GL_CLAMP, GL_CLAMP_TO_EDGE in newer versions
-    clamp_mode = GL_CLAMP;
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, clamp_mode);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, clamp_mode);
-    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-
-    reportGLError("before uploading texture");
-
-    //store the texture data for OpenGL use
-    //glTexImage2D(GL_TEXTURE_2D, level, internal_format, width, height, border, image_format, GL_UNSIGNED_BYTE, bits);
-    if (level > 0) {
-        //glGenerateMipmap(GL_TEXTURE_2D); // only available for OpenGL 3+
-        std::string str(filename);
-        std::size_t pos = str.find('.');
-        str = str.substr(0, pos);
-
-        for (int i = 0; i < level; i++, w /= 2, h /= 2) {
-            std::string file = str + std::to_string(w) + ".tga";
-            fprintf(stderr, "loading file: %s\n", file.c_str());
-            info = tgaLoad(&file[0]);
-            if (info->status != TGA_OK) {
-                fprintf(stderr, "error loading texture image: %s\n", filename);
-                return false;
+void TextureManager::apply(const std::vector<LoadedTexture>& loaded)
+{
+    for (const LoadedTexture& result : loaded)
+    {
+        for (auto& found : entries)
+        {
+            TextureEntry& entry = *found.second;
+            if (entry.loading != result.texture)
+                continue;
+            entry.loading = 0;
+            // a failed first load keeps the placeholder, a failed reload the texture as it is
+            if (result.failed)
+            {
+                if (result.texture != entry.texture)
+                    glDeleteTextures(1, &result.texture);
+                break;
             }
-            glTexImage2D(GL_TEXTURE_2D, i, format, w, h, 0, format, GL_UNSIGNED_BYTE, info->imageData);
+            if (result.texture != entry.texture)
+                glDeleteTextures(1, &entry.texture);
+            memory = memory - entry.size + result.Size();
+            entry.texture = result.texture;
+            entry.levels = result.levels;
+            entry.firstLevel = result.firstLevel;
+            entry.size = result.Size();
+            break;
         }
     }
-    // mipmapping
-    else {
-        glTexImage2D(GL_TEXTURE_2D, level, format, w, h, 0, format, GL_UNSIGNED_BYTE, info->imageData);
-    }
-    reportGLError("after uploading texture");
-
-    tgaDestroy(info);
-    return true;
 }
 
-bool TextureManager::unloadTexture(const unsigned int texID) {
-    bool result(true);
-    //if this texture ID mapped, unload it's texture, and remove it from the map
-    if (m_texID.find(texID) != m_texID.end()) {
-        glDeleteTextures(1, &(m_texID[texID]));
-        m_texID.erase(texID);
-    }
-    //otherwise, unload failed
-    else {
-        result = false;
+void TextureManager::balance()
+{
+    // memory once the running loads are done
+    size_t projected = 0;
+    for (auto& found : entries)
+    {
+        const TextureEntry& entry = *found.second;
+        projected += (entry.loading != 0 && entry.levels.levelCount > 0) ? levelsSize(entry.levels, entry.loadingLevel) : entry.size;
     }
 
-    return result;
-}
-
-bool TextureManager::bindTexture(const unsigned int texID) {
-    bool result(true);
-    if (m_texID.find(texID) != m_texID.end()) //if this texture ID mapped, bind it's texture as current
+    // over the budget: the least recently used textures lose their largest level, one level per texture and frame
+    while (projected > budget)
     {
-        glBindTexture(GL_TEXTURE_2D, m_texID[texID]);
+        TextureEntry* oldest = nullptr;
+        for (auto& found : entries)
+        {
+            TextureEntry& entry = *found.second;
+            if (entry.loading == 0 && entry.firstLevel + 1 < entry.levels.levelCount && (!oldest || entry.lastUsed < oldest->lastUsed))
+                oldest = &entry;
+        }
+        if (!oldest)
+            break;
+        projected -= oldest->size - levelsSize(oldest->levels, oldest->firstLevel + 1);
+        request(*oldest, oldest->firstLevel + 1);
     }
-    else //otherwise, binding failed
+
+    // room left: textures used in the last frame get their next larger level back
+    for (auto& found : entries)
     {
-        fprintf(stderr, "error binding texture image for id: %d\n", texID);
-        result = false;
+        TextureEntry& entry = *found.second;
+        if (entry.loading != 0 || entry.firstLevel == 0 || entry.lastUsed != frame)
+            continue;
+        size_t grown = levelsSize(entry.levels, entry.firstLevel - 1);
+        if (projected - entry.size + grown > budget)
+            continue;
+        projected += grown - entry.size;
+        request(entry, entry.firstLevel - 1);
     }
-    return result;
 }
-
-void TextureManager::unloadAllTextures() {
-    //start at the begginning of the texture map
-    std::map<unsigned int, GLuint>::iterator i = m_texID.begin();
-
-    //Unload the textures untill the end of the texture map is found
-    while (i != m_texID.end())
-        unloadTexture(i->first);
-
-    //clear the texture map
-    m_texID.clear();
-}
\ No newline at end of file
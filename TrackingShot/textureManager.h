@@ -0,0 +1,92 @@
+#pragma once
+
+// Texture manager
+// every texture goes through here: an image is loaded once per usage however many handles refer to it and deleted
+// with the last handle. images load in the background (textureLoader.h) behind a placeholder.
+// the GPU memory of every texture is tracked. over the budget, the least recently bound textures lose their largest
+// mip level (a copy without it is loaded from the texture cache and replaces the texture) until the total fits, and
+// get it back while they are bound and there is room again.
+
+#include <GL/glew.h> // include glew before gl.h (from glfw3)
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "textureLoader.h"
+
+struct TextureEntry
+{
+    std::string path;
+    Texture_Usage usage;
+    unsigned int references;
+    GLuint texture; // in use
+    GLuint loading; // requested from the loader, texture itself on the first load, 0 if nothing is loading
+    unsigned int loadingLevel; // first mip level of the image in loading
+    TextureLevels levels; // of the image, known once it is loaded
+    unsigned int firstLevel; // first mip level of the image in texture
+    size_t size; // bytes of texture on the GPU
+    unsigned int lastUsed; // frame of the last bind
+};
+
+class TextureManager;
+
+// shared reference to a texture of a TextureManager, must not outlive the manager
+class TextureHandle
+{
+public:
+    TextureHandle() : manager(nullptr), entry(nullptr) {}
+    TextureHandle(const TextureHandle& other);
+    TextureHandle& operator=(const TextureHandle& other);
+    ~TextureHandle();
+
+    bool isValid() const { return entry != nullptr; }
+    // texture object, replaced when mip levels are evicted or restored, so it is looked up whenever it is bound
+    GLuint Id() const { return (entry) ? entry->texture : 0; }
+
+private:
+    friend class TextureManager;
+    TextureHandle(TextureManager* manager, TextureEntry* entry);
+
+    TextureManager* manager;
+    TextureEntry* entry;
+};
+
+class TextureManager
+{
+public:
+    // budget in bytes of GPU memory for all textures
+    explicit TextureManager(size_t budget);
+    ~TextureManager();
+
+    // the texture of the image at path, started loading by the first request
+    TextureHandle load(const std::string& path, Texture_Usage usage = TEXTURE_COLOR);
+    // binds texture to unit and marks it as used in this frame
+    void bind(const TextureHandle& texture, GLuint unit);
+    // once per frame: uploads loaded images (uploadBudget bytes, see TextureLoader::update) and evicts or restores
+    // mip levels for the budget
+    void update(size_t uploadBudget);
+    // blocks until every requested image is uploaded
+    void finish();
+
+    void setBudget(size_t bytes) { budget = bytes; }
+    size_t Budget() const { return budget; }
+    // bytes of all textures on the GPU
+    size_t Memory() const { return memory; }
+
+private:
+    friend class TextureHandle;
+    void release(TextureEntry* entry);
+    void request(TextureEntry& entry, unsigned int firstLevel);
+    // takes the finished loads
+    void apply(const std::vector<LoadedTexture>& loaded);
+    // evicts or restores mip levels
+    void balance();
+
+    TextureLoader loader;
+    std::map<std::string, std::unique_ptr<TextureEntry>> entries; // by usage and path
+    size_t budget;
+    size_t memory;
+    unsigned int frame;
+};
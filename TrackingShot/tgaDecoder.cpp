@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include "mappedFile.h"
+#include "tgaDecoder.h"
+
+// the swizzle needs SSSE3 (pshufb); MSVC has no SSSE3 switch and defines __AVX__ / __AVX2__ with /arch:AVX and
+// /arch:AVX2 (EnableEnhancedInstructionSet in the project), gcc and clang define __SSSE3__ with -mssse3 and above
+#if defined(__SSSE3__) || defined(__AVX__) || defined(__AVX2__)
+#include <immintrin.h>
+#define TGA_SIMD
+#endif
+
+const size_t TGA_HEADER_SIZE = 18;
+
+enum Tga_Type {
+    TGA_COLOR = 2,
+    TGA_GREY = 3,
+    TGA_COLOR_RLE = 10,
+    TGA_GREY_RLE = 11
+};
+
+struct TgaHeader
+{
+    int width, height;
+    int bytesPerPixel; // 1, 3 or 4
+    bool rle;
+    bool topDown; // first row is the top one
+    size_t dataOffset;
+};
+
+static bool readHeader(const MappedFile& file, TgaHeader& header)
+{
+    const unsigned char* data = file.Data();
+    if (data == nullptr || file.Size() < TGA_HEADER_SIZE)
+        return false;
+    int type = data[2], depth = data[16];
+    bool grey = type == TGA_GREY || type == TGA_GREY_RLE;
+    if (data[1] != 0 || !(type == TGA_COLOR || type == TGA_COLOR_RLE || grey) || (grey ? depth != 8 : depth != 24 && depth != 32))
+        return false;
+    header.width = data[12] | data[13] << 8;
+    header.height = data[14] | data[15] << 8;
+    header.bytesPerPixel = depth / 8;
+    header.rle = type == TGA_COLOR_RLE || type == TGA_GREY_RLE;
+    header.topDown = (data[17] & 0x20) != 0;
+    header.dataOffset = TGA_HEADER_SIZE + data[0];
+    return header.width > 0 && header.height > 0 && header.dataOffset <= file.Size();
+}
+
+// one pixel of the file (grey, BGR or BGRA) as components channels
+static void convertPixel(const unsigned char* source, int bytesPerPixel, unsigned char* target, int components)
+{
+    unsigned char r, g, b, a = 255;
+    if (bytesPerPixel == 1)
+    {
+        r = g = b = source[0];
+    }
+    else
+    {
+        b = source[0];
+        g = source[1];
+        r = source[2];
+        if (bytesPerPixel == 4)
+            a = source[3];
+    }
+    switch (components)
+    {
+    case 1: target[0] = (unsigned char)((r * 77 + g * 150 + b * 29) >> 8); break;
+    case 2: target[0] = (unsigned char)((r * 77 + g * 150 + b * 29) >> 8); target[1] = a; break;
+    case 3: target[0] = r; target[1] = g; target[2] = b; break;
+    default: target[0] = r; target[1] = g; target[2] = b; target[3] = a; break;
+    }
+}
+
+// count pixels of the file converted to components channels
+static void convertPixels(const unsigned char* source, int bytesPerPixel, unsigned char* target, int components, int count)
+{
+    int i = 0;
+#ifdef TGA_SIMD
+    if (bytesPerPixel == 3 && components == 3)
+    {
+        // five pixels per shuffle, the 16th byte is written again by the next step; 16 bytes are read and written,
+        // so the last five pixels go through the scalar loop
+        const __m128i swizzle = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+        for (; i + 6 <= count; i += 5)
+            _mm_storeu_si128((__m128i*)(target + i * 3), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(source + i * 3)), swizzle));
+    }
+    else if (bytesPerPixel == 4 && components == 4)
+    {
+        const __m128i swizzle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_si128((__m128i*)(target + i * 4), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(source + i * 4)), swizzle));
+    }
+#endif
+    for (; i < count; ++i)
+        convertPixel(source + i * bytesPerPixel, bytesPerPixel, target + i * components, components);
+}
+
+// count copies of one pixel of the file converted to components channels (an RLE run)
+static void fillPixels(const unsigned char* source, int bytesPerPixel, unsigned char* target, int components, int count)
+{
+    unsigned char pixel[4];
+    convertPixel(source, bytesPerPixel, pixel, components);
+    int i = 0;
+#ifdef TGA_SIMD
+    if (components == 4)
+    {
+        int value;
+        std::memcpy(&value, pixel, 4);
+        const __m128i run = _mm_set1_epi32(value);
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_si128((__m128i*)(target + i * 4), run);
+    }
+    else if (components == 3 && count >= 16)
+    {
+        // 16 pixels are 48 bytes, three registers with the pattern in its three phases
+        unsigned char pattern[48];
+        for (int p = 0; p < 16; ++p)
+            std::memcpy(pattern + p * 3, pixel, 3);
+        const __m128i run0 = _mm_loadu_si128((const __m128i*)pattern);
+        const __m128i run1 = _mm_loadu_si128((const __m128i*)(pattern + 16));
+        const __m128i run2 = _mm_loadu_si128((const __m128i*)(pattern + 32));
+        for (; i + 16 <= count; i += 16)
+        {
+            _mm_storeu_si128((__m128i*)(target + i * 3), run0);
+            _mm_storeu_si128((__m128i*)(target + i * 3 + 16), run1);
+            _mm_storeu_si128((__m128i*)(target + i * 3 + 32), run2);
+        }
+    }
+#endif
+    for (; i < count; ++i)
+        std::memcpy(target + i * components, pixel, components);
+}
+
+bool isTga(const std::string& path)
+{
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos || path.size() - dot != 4)
+        return false;
+    std::string extension = path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+    return extension == "tga";
+}
+
+std::string tgaLevelPath(const std::string& path, int width)
+{
+    return path.substr(0, path.rfind('.')) + std::to_string(width) + ".tga";
+}
+
+bool tgaInfo(const std::string& path, int& width, int& height, int& components)
+{
+    MappedFile file(path);
+    TgaHeader header;
+    if (!readHeader(file, header))
+        return false;
+    width = header.width;
+    height = header.height;
+    components = header.bytesPerPixel;
+    return true;
+}
+
+bool tgaLoad(const std::string& path, unsigned char* pixels, int components)
+{
+    MappedFile file(path);
+    TgaHeader header;
+    if (!readHeader(file, header))
+        return false;
+    const unsigned char* source = file.Data() + header.dataOffset;
+    const unsigned char* end = file.Data() + file.Size();
+    const int bytesPerPixel = header.bytesPerPixel, width = header.width, height = header.height;
+    const size_t rowBytes = (size_t)width * components;
+    // rows of the file in the order they are stored
+    auto row = [&](int y) { return pixels + (size_t)(header.topDown ? y : height - 1 - y) * rowBytes; };
+
+    if (!header.rle)
+    {
+        if ((size_t)(end - source) < (size_t)width * height * bytesPerPixel)
+            return false;
+        for (int y = 0; y < height; ++y)
+            convertPixels(source + (size_t)y * width * bytesPerPixel, bytesPerPixel, row(y), components, width);
+        return true;
+    }
+
+    // packets: a header byte with the pixel count - 1 in the low 7 bits and the high bit set for a run of one pixel,
+    // otherwise that many raw pixels follow. packets may continue on the next row
+    int x = 0, y = 0;
+    while (y < height)
+    {
+        if (source >= end)
+            return false;
+        int packet = *source++;
+        int count = (packet & 0x7F) + 1;
+        bool run = (packet & 0x80) != 0;
+        size_t packetBytes = (size_t)(run ? 1 : count) * bytesPerPixel;
+        if ((size_t)(end - source) < packetBytes)
+            return false;
+        while (count > 0 && y < height)
+        {
+            int span = std::min(count, width - x);
+            unsigned char* target = row(y) + (size_t)x * components;
+            if (run)
+            {
+                fillPixels(source, bytesPerPixel, target, components, span);
+            }
+            else
+            {
+                convertPixels(source, bytesPerPixel, target, components, span);
+                source += (size_t)span * bytesPerPixel;
+            }
+            count -= span;
+            x += span;
+            if (x == width)
+            {
+                x = 0;
+                ++y;
+            }
+        }
+        if (run)
+            source += bytesPerPixel;
+    }
+    return true;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+// TGA decoder
+// reads uncompressed and RLE compressed TGA images (8 bit grey, 24 and 32 bit color) from a mapped file straight into
+// a buffer of the caller, top row first like stb_image. the BGR(A) to RGB(A) swizzle and the expansion of RLE runs
+// work on 16 bytes at a time with SSSE3 shuffles when the compiler targets AVX2. color mapped and 16 bit images are
+// left to stb_image.
+
+#include <string>
+
+bool isTga(const std::string& path);
+// file that may hold the mip level of the given width of the TGA image at path (wall.tga -> wall256.tga)
+std::string tgaLevelPath(const std::string& path, int width);
+// size and channels of the TGA image at path, false if it is not one this decoder reads
+bool tgaInfo(const std::string& path, int& width, int& height, int& components);
+// decodes the TGA image at path into pixels (width x height texels of components 8 bit channels, see tgaInfo),
+// components 1 - 4 convert like the requested components of stb_image
+bool tgaLoad(const std::string& path, unsigned char* pixels, int components);
@@ -3,6 +3,12 @@
 #include <gtc/type_ptr.hpp>
 
 Light gLight;
+// point lights with cube shadows, placed around the scene
+const unsigned int POINT_LIGHT_COUNT = 8;
+Light pointLights[POINT_LIGHT_COUNT];
+// many small unshadowed lights floating over the ground, shaded through the light clusters
+const unsigned int SMALL_LIGHT_COUNT = 256;
+Light smallLights[SMALL_LIGHT_COUNT];
 std::vector<Light * > lights;
 
 // set up vertex data (and buffer(s)) and configure vertex attributes